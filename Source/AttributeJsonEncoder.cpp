@@ -0,0 +1,87 @@
+#include "AttributeJsonEncoder.hpp"
+
+static const UInt32 ReplacementCharacter = 0xFFFD;
+static const char HexDigits[] = "0123456789abcdef";
+
+AttributeJsonEncoder::AttributeJsonEncoder () :
+    buffer ()
+{
+
+}
+
+void AttributeJsonEncoder::Encode (const GS::UniString& name, const GS::UniString& value, const GS::UniString& type)
+{
+    buffer.clear ();
+    buffer.push_back ('[');
+    AppendString (name);
+    buffer.push_back (',');
+    AppendString (value);
+    buffer.push_back (',');
+    AppendString (type);
+    buffer.push_back (']');
+}
+
+const char* AttributeJsonEncoder::GetData () const
+{
+    return buffer.data ();
+}
+
+size_t AttributeJsonEncoder::GetSize () const
+{
+    return buffer.size ();
+}
+
+void AttributeJsonEncoder::AppendString (const GS::UniString& str)
+{
+    // Reads the UTF-16 content in place, unpaired surrogates become replacement characters
+    auto content = str.ToUStr ();
+    const GS::uchar_t* characters = content.Get ();
+    GS::USize length = str.GetLength ();
+    buffer.push_back ('"');
+    for (GS::USize i = 0; i < length; ++i) {
+        UInt32 codeUnit = characters[i];
+        if (codeUnit >= 0xD800 && codeUnit <= 0xDBFF && i + 1 < length && characters[i + 1] >= 0xDC00 && characters[i + 1] <= 0xDFFF) {
+            UInt32 lowSurrogate = characters[i + 1];
+            AppendCodePoint (0x10000 + ((codeUnit - 0xD800) << 10) + (lowSurrogate - 0xDC00));
+            i += 1;
+        } else if (codeUnit >= 0xD800 && codeUnit <= 0xDFFF) {
+            AppendCodePoint (ReplacementCharacter);
+        } else {
+            AppendCodePoint (codeUnit);
+        }
+    }
+    buffer.push_back ('"');
+}
+
+void AttributeJsonEncoder::AppendCodePoint (UInt32 codePoint)
+{
+    switch (codePoint) {
+        case '"':  buffer.push_back ('\\'); buffer.push_back ('"'); return;
+        case '\\': buffer.push_back ('\\'); buffer.push_back ('\\'); return;
+        case '\b': buffer.push_back ('\\'); buffer.push_back ('b'); return;
+        case '\f': buffer.push_back ('\\'); buffer.push_back ('f'); return;
+        case '\n': buffer.push_back ('\\'); buffer.push_back ('n'); return;
+        case '\r': buffer.push_back ('\\'); buffer.push_back ('r'); return;
+        case '\t': buffer.push_back ('\\'); buffer.push_back ('t'); return;
+        default: break;
+    }
+
+    if (codePoint < 0x20) {
+        const char escape[] = { '\\', 'u', '0', '0', HexDigits[codePoint >> 4], HexDigits[codePoint & 0xF] };
+        buffer.insert (buffer.end (), escape, escape + sizeof (escape));
+    } else if (codePoint < 0x80) {
+        buffer.push_back ((char) codePoint);
+    } else if (codePoint < 0x800) {
+        buffer.push_back ((char) (0xC0 | (codePoint >> 6)));
+        buffer.push_back ((char) (0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        buffer.push_back ((char) (0xE0 | (codePoint >> 12)));
+        buffer.push_back ((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+        buffer.push_back ((char) (0x80 | (codePoint & 0x3F)));
+    } else {
+        buffer.push_back ((char) (0xF0 | (codePoint >> 18)));
+        buffer.push_back ((char) (0x80 | ((codePoint >> 12) & 0x3F)));
+        buffer.push_back ((char) (0x80 | ((codePoint >> 6) & 0x3F)));
+        buffer.push_back ((char) (0x80 | (codePoint & 0x3F)));
+    }
+}
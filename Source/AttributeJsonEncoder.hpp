@@ -0,0 +1,24 @@
+#pragma once
+
+#include <UniString.hpp>
+
+#include <vector>
+
+// Encodes name, value, type attribute triples as a JSON array of UTF-8 strings. The buffer
+// is kept between attributes, so an encoder should be reused and owned by one thread.
+class AttributeJsonEncoder
+{
+public:
+    AttributeJsonEncoder ();
+
+    void Encode (const GS::UniString& name, const GS::UniString& value, const GS::UniString& type);
+
+    const char* GetData () const;
+    size_t GetSize () const;
+
+private:
+    void AppendString (const GS::UniString& str);
+    void AppendCodePoint (UInt32 codePoint);
+
+    std::vector<char> buffer;
+};
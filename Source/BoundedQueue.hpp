@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Definitions.hpp>
+
+#include <atomic>
+#include <vector>
+
+// Lock-free multi-producer multi-consumer queue with a fixed capacity. Every cell has a
+// sequence number telling whether it is free for the producer of a position or holds
+// the value for the consumer of that position, so a push or pop is a single CAS.
+template <typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue (size_t minCapacity) :
+        cells (GetCapacity (minCapacity)),
+        mask (cells.size () - 1),
+        enqueuePosition (0),
+        dequeuePosition (0)
+    {
+        for (size_t i = 0; i < cells.size (); ++i) {
+            cells[i].sequence.store (i, std::memory_order_relaxed);
+        }
+    }
+
+    bool TryPush (const T& value)
+    {
+        size_t position = enqueuePosition.load (std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load (std::memory_order_acquire);
+            if (sequence == position) {
+                if (enqueuePosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store (position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position) {
+                return false;
+            } else {
+                position = enqueuePosition.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryPop (T& value)
+    {
+        size_t position = dequeuePosition.load (std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load (std::memory_order_acquire);
+            if (sequence == position + 1) {
+                if (dequeuePosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store (position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position + 1) {
+                return false;
+            } else {
+                position = dequeuePosition.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    class Cell
+    {
+    public:
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t GetCapacity (size_t minCapacity)
+    {
+        size_t capacity = 2;
+        while (capacity < minCapacity) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas (64) std::atomic<size_t> enqueuePosition;
+    alignas (64) std::atomic<size_t> dequeuePosition;
+};
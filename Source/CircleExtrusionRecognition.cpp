@@ -0,0 +1,440 @@
+#include "CircleExtrusionRecognition.hpp"
+
+#include <unordered_map>
+
+// Prisms with fewer sides are usually modeled that way and must stay faceted
+static const uint32_t MinCircleSegmentCount = 12;
+static const double StraightAngleTolerance = 1.0e-4;
+static const UInt32 NoProfile = (UInt32) -1;
+
+// Bends are bounded by the circles at steps of at most this angle along the bend
+static const double MaxBoundsStepAngle = PI / 64.0;
+
+class TubeRing
+{
+public:
+    TubeRing () :
+        indices (),
+        center (0.0, 0.0, 0.0),
+        direction (0.0, 0.0, 0.0),
+        radius (0.0)
+    {
+
+    }
+
+    std::vector<uint16_t> indices;
+    Vector3D center;
+    Vector3D direction;
+    double radius;
+};
+
+static UInt32 GetEdgeKey (uint16_t from, uint16_t to)
+{
+    return ((UInt32) from << 16) | (UInt32) to;
+}
+
+static double Dot (const Vector3D& a, const Vector3D& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3D Cross (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static Vector3D Add (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static Vector3D Subtract (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static Vector3D Scale (const Vector3D& a, double scale)
+{
+    return Vector3D (a.x * scale, a.y * scale, a.z * scale);
+}
+
+static double Length (const Vector3D& a)
+{
+    return sqrt (Dot (a, a));
+}
+
+static Vector3D Normalize (const Vector3D& a)
+{
+    double length = Length (a);
+    return length > 0.0 ? Scale (a, 1.0 / length) : a;
+}
+
+static UInt32 FindRoot (std::vector<UInt32>& parents, UInt32 index)
+{
+    while (parents[index] != index) {
+        parents[index] = parents[parents[index]];
+        index = parents[index];
+    }
+    return index;
+}
+
+// The tube is two caps with the same number of sides and quads between them. The rings of
+// the tube are collected by walking from the first cap across the quads to the second one.
+static bool WalkTubeRings (
+    const ShellGeometry& shell,
+    const std::vector<size_t>& profileStarts,
+    const std::vector<UInt32>& tubeProfiles,
+    std::vector<TubeRing>& rings)
+{
+    UInt32 firstCap = NoProfile;
+    UInt32 lastCap = NoProfile;
+    for (UInt32 profileIndex : tubeProfiles) {
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        if (profileSize == 4) {
+            continue;
+        }
+        if (profileSize < MinCircleSegmentCount) {
+            return false;
+        }
+        if (firstCap == NoProfile) {
+            firstCap = profileIndex;
+        } else if (lastCap == NoProfile) {
+            lastCap = profileIndex;
+        } else {
+            return false;
+        }
+    }
+    if (lastCap == NoProfile || shell.profileSizes[firstCap] != shell.profileSizes[lastCap]) {
+        return false;
+    }
+    uint32_t segmentCount = shell.profileSizes[firstCap];
+    if ((tubeProfiles.size () - 2) % segmentCount != 0) {
+        return false;
+    }
+    size_t ringCount = (tubeProfiles.size () - 2) / segmentCount + 1;
+
+    std::unordered_map<UInt32, UInt32> edgeProfiles;
+    for (UInt32 profileIndex : tubeProfiles) {
+        const uint16_t* indices = &shell.profileIndices[profileStarts[profileIndex]];
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            if (!edgeProfiles.insert ({ GetEdgeKey (indices[i], indices[(i + 1) % profileSize]), profileIndex }).second) {
+                return false;
+            }
+        }
+    }
+
+    std::vector<bool> usedPoints (shell.points.size (), false);
+    const uint16_t* capIndices = &shell.profileIndices[profileStarts[firstCap]];
+    TubeRing ring;
+    ring.indices.assign (capIndices, capIndices + segmentCount);
+    for (uint16_t index : ring.indices) {
+        usedPoints[index] = true;
+    }
+    rings.push_back (ring);
+
+    std::vector<uint16_t> nextIndices (segmentCount);
+    std::vector<uint16_t> nextToIndices (segmentCount);
+    while (rings.size () < ringCount) {
+        const std::vector<uint16_t>& indices = rings.back ().indices;
+        for (uint32_t i = 0; i < segmentCount; ++i) {
+            uint16_t from = indices[i];
+            uint16_t to = indices[(i + 1) % segmentCount];
+            auto found = edgeProfiles.find (GetEdgeKey (to, from));
+            if (found == edgeProfiles.end () || shell.profileSizes[found->second] != 4) {
+                return false;
+            }
+            const uint16_t* quad = &shell.profileIndices[profileStarts[found->second]];
+            uint32_t position = 0;
+            while (quad[position] != to) {
+                ++position;
+            }
+            if (quad[(position + 1) % 4] != from) {
+                return false;
+            }
+            nextIndices[i] = quad[(position + 2) % 4];
+            nextToIndices[i] = quad[(position + 3) % 4];
+        }
+        TubeRing nextRing;
+        for (uint32_t i = 0; i < segmentCount; ++i) {
+            if (nextToIndices[i] != nextIndices[(i + 1) % segmentCount] || usedPoints[nextIndices[i]]) {
+                return false;
+            }
+            usedPoints[nextIndices[i]] = true;
+        }
+        nextRing.indices = nextIndices;
+        rings.push_back (nextRing);
+    }
+
+    const std::vector<uint16_t>& lastIndices = rings.back ().indices;
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        auto found = edgeProfiles.find (GetEdgeKey (lastIndices[(i + 1) % segmentCount], lastIndices[i]));
+        if (found == edgeProfiles.end () || found->second != lastCap) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool FitTubeRing (const std::vector<Vector3D>& points, double tolerance, TubeRing& ring)
+{
+    Vector3D normal (0.0, 0.0, 0.0);
+    for (size_t i = 0; i < ring.indices.size (); ++i) {
+        const Vector3D& current = points[ring.indices[i]];
+        const Vector3D& next = points[ring.indices[(i + 1) % ring.indices.size ()]];
+        normal.x += (current.y - next.y) * (current.z + next.z);
+        normal.y += (current.z - next.z) * (current.x + next.x);
+        normal.z += (current.x - next.x) * (current.y + next.y);
+        ring.center = Add (ring.center, current);
+    }
+    if (Dot (normal, normal) <= 0.0) {
+        return false;
+    }
+    ring.direction = Normalize (normal);
+    ring.center = Scale (ring.center, 1.0 / (double) ring.indices.size ());
+
+    for (uint16_t index : ring.indices) {
+        ring.radius += Length (Subtract (points[index], ring.center));
+    }
+    ring.radius /= (double) ring.indices.size ();
+    for (uint16_t index : ring.indices) {
+        Vector3D offset = Subtract (points[index], ring.center);
+        if (fabs (Length (offset) - ring.radius) > tolerance || fabs (Dot (offset, ring.direction)) > tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool AddAxisSegment (const TubeRing& ring, const TubeRing& nextRing, double tolerance, std::vector<AxisPartGeometry>& axisParts)
+{
+    Vector3D chord = Subtract (nextRing.center, ring.center);
+    double chordLength = Length (chord);
+    if (chordLength <= tolerance) {
+        return false;
+    }
+
+    double angle = acos (GS::Max (-1.0, GS::Min (1.0, Dot (ring.direction, nextRing.direction))));
+    if (angle <= StraightAngleTolerance) {
+        Vector3D lateral = Subtract (chord, Scale (ring.direction, Dot (chord, ring.direction)));
+        if (Dot (chord, ring.direction) <= 0.0 || Length (lateral) > tolerance) {
+            return false;
+        }
+        if (!axisParts.empty () && axisParts.back ().type == AxisPartType::Wire) {
+            AxisPartGeometry& wire = axisParts.back ();
+            if (Length (Cross (Normalize (Subtract (wire.end, wire.start)), Scale (chord, 1.0 / chordLength))) <= StraightAngleTolerance) {
+                wire.end = nextRing.center;
+                return true;
+            }
+        }
+        AxisPartGeometry wire;
+        wire.type = AxisPartType::Wire;
+        wire.start = ring.center;
+        wire.end = nextRing.center;
+        axisParts.push_back (wire);
+        return true;
+    }
+
+    // Bend: circular arc starting tangent to the ring direction and turning by the angle between the rings
+    Vector3D bendNormal = Normalize (Cross (ring.direction, nextRing.direction));
+    Vector3D toCenter = Normalize (Cross (bendNormal, ring.direction));
+    double bendRadius = chordLength / (2.0 * sin (angle * 0.5));
+    Vector3D center = Add (ring.center, Scale (toCenter, bendRadius));
+    Vector3D expectedEnd = Add (ring.center, Add (Scale (ring.direction, bendRadius * sin (angle)), Scale (toCenter, bendRadius * (1.0 - cos (angle)))));
+    if (Length (Subtract (expectedEnd, nextRing.center)) > tolerance) {
+        return false;
+    }
+
+    if (!axisParts.empty () && axisParts.back ().type == AxisPartType::CircleCurve) {
+        AxisPartGeometry& curve = axisParts.back ();
+        if (Length (Subtract (curve.center, center)) <= tolerance && fabs (curve.radius - bendRadius) <= tolerance &&
+            Dot (Cross (curve.xDirection, curve.yDirection), bendNormal) >= 1.0 - StraightAngleTolerance)
+        {
+            curve.aperture += angle;
+            return true;
+        }
+    }
+    AxisPartGeometry curve;
+    curve.type = AxisPartType::CircleCurve;
+    curve.center = center;
+    curve.radius = bendRadius;
+    curve.aperture = angle;
+    curve.xDirection = Scale (toCenter, -1.0);
+    curve.yDirection = ring.direction;
+    axisParts.push_back (curve);
+    return true;
+}
+
+// The circle is perpendicular to the unit direction, so its extent along an axis is the radius
+// scaled by the sine of the angle between the axis and the direction. The margin widens it.
+static void AddCircleBounds (const Vector3D& center, const Vector3D& direction, double radius, double margin, CircleExtrusionGeometry& circleExtrusion)
+{
+    Vector3D extent (
+        radius * sqrt (GS::Max (0.0, 1.0 - direction.x * direction.x)) + margin,
+        radius * sqrt (GS::Max (0.0, 1.0 - direction.y * direction.y)) + margin,
+        radius * sqrt (GS::Max (0.0, 1.0 - direction.z * direction.z)) + margin
+    );
+    circleExtrusion.min.x = GS::Min (circleExtrusion.min.x, center.x - extent.x);
+    circleExtrusion.min.y = GS::Min (circleExtrusion.min.y, center.y - extent.y);
+    circleExtrusion.min.z = GS::Min (circleExtrusion.min.z, center.z - extent.z);
+    circleExtrusion.max.x = GS::Max (circleExtrusion.max.x, center.x + extent.x);
+    circleExtrusion.max.y = GS::Max (circleExtrusion.max.y, center.y + extent.y);
+    circleExtrusion.max.z = GS::Max (circleExtrusion.max.z, center.z + extent.z);
+}
+
+// A straight part lies in the hull of its end circles. A point of a bend turns around the bend axis,
+// so between two circles its coordinates exceed theirs by at most the sagitta of the outer radius.
+static void ComputeCircleExtrusionBounds (CircleExtrusionGeometry& circleExtrusion)
+{
+    double radius = circleExtrusion.radius;
+    for (const AxisPartGeometry& axisPart : circleExtrusion.axisParts) {
+        if (axisPart.type == AxisPartType::Wire) {
+            Vector3D direction = Normalize (Subtract (axisPart.end, axisPart.start));
+            AddCircleBounds (axisPart.start, direction, radius, 0.0, circleExtrusion);
+            AddCircleBounds (axisPart.end, direction, radius, 0.0, circleExtrusion);
+            continue;
+        }
+        UInt32 stepCount = (UInt32) ceil (axisPart.aperture / MaxBoundsStepAngle);
+        double stepAngle = axisPart.aperture / (double) stepCount;
+        double margin = (axisPart.radius + radius) * (1.0 - cos (stepAngle * 0.5));
+        for (UInt32 step = 0; step <= stepCount; ++step) {
+            double angle = stepAngle * (double) step;
+            Vector3D center = Add (axisPart.center, Add (Scale (axisPart.xDirection, axisPart.radius * cos (angle)), Scale (axisPart.yDirection, axisPart.radius * sin (angle))));
+            Vector3D direction = Add (Scale (axisPart.xDirection, -sin (angle)), Scale (axisPart.yDirection, cos (angle)));
+            AddCircleBounds (center, direction, radius, margin, circleExtrusion);
+        }
+    }
+}
+
+static bool RecognizeTube (
+    const ShellGeometry& shell,
+    const std::vector<size_t>& profileStarts,
+    const std::vector<UInt32>& tubeProfiles,
+    double tolerance,
+    CircleExtrusionGeometry& circleExtrusion,
+    size_t& tubePointCount)
+{
+    std::vector<TubeRing> rings;
+    if (!WalkTubeRings (shell, profileStarts, tubeProfiles, rings)) {
+        return false;
+    }
+
+    double radius = 0.0;
+    for (TubeRing& ring : rings) {
+        if (!FitTubeRing (shell.points, tolerance, ring)) {
+            return false;
+        }
+        radius += ring.radius;
+    }
+    radius /= (double) rings.size ();
+
+    // Ring normals follow the orientation of the first cap, which faces away from the tube
+    double orientation = Dot (rings[0].direction, Subtract (rings[1].center, rings[0].center)) < 0.0 ? -1.0 : 1.0;
+    for (TubeRing& ring : rings) {
+        if (fabs (ring.radius - radius) > tolerance) {
+            return false;
+        }
+        ring.direction = Scale (ring.direction, orientation);
+    }
+
+    for (size_t i = 0; i + 1 < rings.size (); ++i) {
+        if (!AddAxisSegment (rings[i], rings[i + 1], tolerance, circleExtrusion.axisParts)) {
+            return false;
+        }
+    }
+
+    circleExtrusion.radius = radius;
+    ComputeCircleExtrusionBounds (circleExtrusion);
+    tubePointCount = 0;
+    for (const TubeRing& ring : rings) {
+        tubePointCount += ring.indices.size ();
+    }
+    return true;
+}
+
+size_t ExtractCircleExtrusions (ShellGeometry& shell, double tolerance, std::vector<CircleExtrusionGeometry>& circleExtrusions)
+{
+    UInt32 profileCount = (UInt32) shell.profileSizes.size ();
+    bool hasCapCandidate = false;
+    for (uint32_t profileSize : shell.profileSizes) {
+        hasCapCandidate = hasCapCandidate || profileSize >= MinCircleSegmentCount;
+    }
+    if (!hasCapCandidate) {
+        return 0;
+    }
+
+    // Tubes are the connected parts of the shell
+    std::vector<UInt32> parents (shell.points.size ());
+    for (UInt32 pointIndex = 0; pointIndex < parents.size (); ++pointIndex) {
+        parents[pointIndex] = pointIndex;
+    }
+    std::vector<size_t> profileStarts (profileCount, 0);
+    size_t profileStart = 0;
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        profileStarts[profileIndex] = profileStart;
+        for (uint32_t i = 1; i < shell.profileSizes[profileIndex]; ++i) {
+            UInt32 root = FindRoot (parents, shell.profileIndices[profileStart]);
+            UInt32 otherRoot = FindRoot (parents, shell.profileIndices[profileStart + i]);
+            parents[GS::Max (root, otherRoot)] = GS::Min (root, otherRoot);
+        }
+        profileStart += shell.profileSizes[profileIndex];
+    }
+
+    std::vector<UInt32> partIndices (shell.points.size (), NoProfile);
+    std::vector<std::vector<UInt32>> parts;
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        UInt32 root = FindRoot (parents, shell.profileIndices[profileStarts[profileIndex]]);
+        if (partIndices[root] == NoProfile) {
+            partIndices[root] = (UInt32) parts.size ();
+            parts.emplace_back ();
+        }
+        parts[partIndices[root]].push_back (profileIndex);
+    }
+
+    std::vector<bool> hasHoles (profileCount, false);
+    for (uint16_t holeProfile : shell.holeProfiles) {
+        hasHoles[holeProfile] = true;
+    }
+
+    std::vector<bool> removedProfiles (profileCount, false);
+    size_t replacedPointCount = 0;
+    for (const std::vector<UInt32>& part : parts) {
+        bool partHasHoles = false;
+        for (UInt32 profileIndex : part) {
+            partHasHoles = partHasHoles || hasHoles[profileIndex];
+        }
+        CircleExtrusionGeometry circleExtrusion (shell.materialIndex);
+        size_t tubePointCount = 0;
+        if (part.size () < 2 + MinCircleSegmentCount || partHasHoles || !RecognizeTube (shell, profileStarts, part, tolerance, circleExtrusion, tubePointCount)) {
+            continue;
+        }
+        for (UInt32 profileIndex : part) {
+            removedProfiles[profileIndex] = true;
+        }
+        circleExtrusions.push_back (std::move (circleExtrusion));
+        replacedPointCount += tubePointCount;
+    }
+    if (replacedPointCount == 0) {
+        return 0;
+    }
+
+    std::vector<uint16_t> profileIndices;
+    std::vector<uint32_t> profileSizes;
+    std::vector<uint16_t> newProfileIndices (profileCount, 0);
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        if (removedProfiles[profileIndex]) {
+            continue;
+        }
+        const uint16_t* indices = &shell.profileIndices[profileStarts[profileIndex]];
+        newProfileIndices[profileIndex] = (uint16_t) profileSizes.size ();
+        profileIndices.insert (profileIndices.end (), indices, indices + shell.profileSizes[profileIndex]);
+        profileSizes.push_back (shell.profileSizes[profileIndex]);
+    }
+    for (uint16_t& holeProfile : shell.holeProfiles) {
+        holeProfile = newProfileIndices[holeProfile];
+    }
+    shell.profileIndices.swap (profileIndices);
+    shell.profileSizes.swap (profileSizes);
+    shell.RemoveUnusedPoints ();
+    return replacedPointCount;
+}
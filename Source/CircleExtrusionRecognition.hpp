@@ -0,0 +1,11 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+
+// Finds the closed tessellated tubes of the shell (cylinders, pipes and bent pipes with
+// circular caps), moves them to circle extrusions and removes them from the shell.
+// Tubes whose points are farther than the tolerance from the recognized surface are kept.
+// Only solid tubes are recognized: a circle extrusion has no inner radius and is closed at
+// both ends, so hollow pipes with annular caps and open tubes without caps stay shells.
+// Returns the number of shell points replaced by circle extrusions.
+size_t ExtractCircleExtrusions (ShellGeometry& shell, double tolerance, std::vector<CircleExtrusionGeometry>& circleExtrusions);
@@ -0,0 +1,235 @@
+#include "CompressedFileWriter.hpp"
+#include "ExportPipeline.hpp"
+#include "TemporaryFile.hpp"
+
+#include <miniz.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+static const size_t InputBlockSize = 1024 * 1024;
+static const size_t DictionarySize = 32 * 1024;
+static const UInt32 Adler32Base = 65521;
+
+// The samples are spread over the buffer, since the element data changes along it
+static const size_t SampleCount = 4;
+static const size_t SampleSize = 256 * 1024;
+
+typedef std::chrono::steady_clock Clock;
+
+class CompressedBlock
+{
+public:
+    CompressedBlock () :
+        output (),
+        checksum (1)
+    {
+
+    }
+
+    std::vector<std::uint8_t> output;
+    UInt32 checksum;
+};
+
+static mz_bool AppendOutput (const void* buffer, int length, void* user)
+{
+    std::vector<std::uint8_t>* output = static_cast<std::vector<std::uint8_t>*> (user);
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*> (buffer);
+    output->insert (output->end (), bytes, bytes + length);
+    return MZ_TRUE;
+}
+
+static mz_bool CountOutput (const void* /*buffer*/, int length, void* user)
+{
+    *static_cast<size_t*> (user) += (size_t) length;
+    return MZ_TRUE;
+}
+
+static mz_uint GetCompressorFlags (const CompressionSettings& compression)
+{
+    int strategy = MZ_DEFAULT_STRATEGY;
+    switch (compression.strategy) {
+        case CompressionStrategy::Filtered: strategy = MZ_FILTERED; break;
+        case CompressionStrategy::RunLength: strategy = MZ_RLE; break;
+        default: break;
+    }
+    // Negative window bits mean raw deflate, the zlib header and the checksum are written here
+    return tdefl_create_comp_flags_from_zip_params (compression.level, -MZ_DEFAULT_WINDOW_BITS, strategy);
+}
+
+// The level in the zlib header is only informative, the check bits make the header a multiple of 31
+static void GetZlibHeader (Int32 level, std::uint8_t header[2])
+{
+    UInt32 levelFlag = 2;
+    if (level >= 0 && level <= 1) {
+        levelFlag = 0;
+    } else if (level >= 2 && level <= 5) {
+        levelFlag = 1;
+    } else if (level >= 7) {
+        levelFlag = 3;
+    }
+    UInt32 flags = levelFlag << 6;
+    header[0] = 0x78;
+    header[1] = (std::uint8_t) (flags + (31 - ((0x78 << 8) + flags) % 31) % 31);
+}
+
+// Adler-32 of two concatenated parts from the checksums of the parts
+static UInt32 CombineAdler32 (UInt32 adler1, UInt32 adler2, size_t length2)
+{
+    UInt32 remainder = (UInt32) (length2 % Adler32Base);
+    UInt32 sum1 = adler1 & 0xffff;
+    UInt32 sum2 = (remainder * sum1) % Adler32Base;
+    sum1 += (adler2 & 0xffff) + Adler32Base - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + Adler32Base - remainder;
+    if (sum1 >= Adler32Base) {
+        sum1 -= Adler32Base;
+    }
+    if (sum1 >= Adler32Base) {
+        sum1 -= Adler32Base;
+    }
+    if (sum2 >= (Adler32Base << 1)) {
+        sum2 -= (Adler32Base << 1);
+    }
+    if (sum2 >= Adler32Base) {
+        sum2 -= Adler32Base;
+    }
+    return sum1 | (sum2 << 16);
+}
+
+CompressionSettings ChooseCompressionSettings (const std::uint8_t* data, size_t size, UInt32 threadCount, double timeBudget, UInt64& trialTime)
+{
+    static const CompressionSettings candidates[] = {
+        CompressionSettings (1, CompressionStrategy::Default),
+        CompressionSettings (3, CompressionStrategy::RunLength),
+        CompressionSettings (3, CompressionStrategy::Default),
+        CompressionSettings (6, CompressionStrategy::Filtered),
+        CompressionSettings (6, CompressionStrategy::Default),
+        CompressionSettings (9, CompressionStrategy::Default)
+    };
+
+    Clock::time_point trialStart = Clock::now ();
+    size_t sampleCount = size > SampleCount * SampleSize ? SampleCount : 1;
+    size_t sampleSize = sampleCount > 1 ? SampleSize : size;
+    size_t sampledSize = sampleCount * sampleSize;
+
+    // The blocks are compressed in parallel, the projection assumes the workers are busy all the time
+    UInt32 workerCount = ExportPipeline (GS::Max (threadCount, (UInt32) 2)).GetWorkerCount ();
+    double scale = sampledSize > 0 ? (double) size / (double) sampledSize / (double) workerCount : 0.0;
+
+    std::unique_ptr<tdefl_compressor> compressor (new tdefl_compressor ());
+    CompressionSettings chosen = candidates[0];
+    size_t chosenSize = 0;
+    for (const CompressionSettings& candidate : candidates) {
+        Clock::time_point candidateStart = Clock::now ();
+        size_t candidateSize = 0;
+        for (size_t sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex) {
+            size_t sampleStart = sampleCount > 1 ? (size - sampleSize) * sampleIndex / (sampleCount - 1) : 0;
+            tdefl_init (compressor.get (), CountOutput, &candidateSize, GetCompressorFlags (candidate));
+            tdefl_compress_buffer (compressor.get (), data + sampleStart, sampleSize, TDEFL_FINISH);
+        }
+        Clock::time_point candidateEnd = Clock::now ();
+
+        // The candidates get slower, so the first one that does not fit ends the trials
+        double projectedTime = std::chrono::duration<double> (candidateEnd - candidateStart).count () * scale;
+        double remainingTime = timeBudget - std::chrono::duration<double> (candidateEnd - trialStart).count ();
+        if (projectedTime > remainingTime) {
+            break;
+        }
+        if (chosenSize == 0 || candidateSize < chosenSize) {
+            chosen = candidate;
+            chosenSize = candidateSize;
+        }
+    }
+
+    trialTime = (UInt64) std::chrono::duration_cast<std::chrono::microseconds> (Clock::now () - trialStart).count ();
+    return chosen;
+}
+
+bool WriteCompressedFile (const IO::Location& location, const std::uint8_t* data, size_t size, const CompressionSettings& compression, UInt32 threadCount, UInt64& compressedSize, UInt64& blockCount)
+{
+    // The previous file stays in place until the new one is complete
+    TemporaryFile file;
+    if (!file.Open (location)) {
+        return false;
+    }
+
+    const mz_uint compressorFlags = GetCompressorFlags (compression);
+    std::uint8_t zlibHeader[2];
+    GetZlibHeader (compression.level, zlibHeader);
+
+    // A writer thread is needed even on a single thread, so writing overlaps the compression
+    ExportPipeline pipeline (GS::Max (threadCount, (UInt32) 2));
+    std::vector<std::unique_ptr<tdefl_compressor>> compressors;
+    for (UInt32 workerIndex = 0; workerIndex < pipeline.GetWorkerCount (); ++workerIndex) {
+        compressors.emplace_back (new tdefl_compressor ());
+    }
+    std::vector<CompressedBlock> compressedBlocks (pipeline.GetSlotCount ());
+    blockCount = GS::Max ((size + InputBlockSize - 1) / InputBlockSize, (size_t) 1);
+
+    if (!file.Write (zlibHeader, sizeof (zlibHeader))) {
+        return false;
+    }
+    bool failed = false;
+    UInt32 checksum = 1;
+    compressedSize = sizeof (zlibHeader);
+
+    auto hostStage = [](size_t, UInt32) {};
+
+    auto workerStage = [&](size_t blockIndex, UInt32 slotIndex, UInt32 workerIndex) {
+        tdefl_compressor* compressor = compressors[workerIndex].get ();
+        CompressedBlock& compressedBlock = compressedBlocks[slotIndex];
+        size_t blockStart = blockIndex * InputBlockSize;
+        size_t blockSize = GS::Min (InputBlockSize, size - blockStart);
+        bool isLastBlock = blockIndex + 1 == blockCount;
+
+        compressedBlock.output.clear ();
+        bool success = tdefl_init (compressor, AppendOutput, &compressedBlock.output, compressorFlags) == TDEFL_STATUS_OKAY;
+
+        // Compressing the end of the previous block fills the dictionary, its output is not needed.
+        // After a sync flush the output is byte aligned, so the block output can start right there.
+        // Stored blocks do not refer back, so they need no dictionary.
+        if (success && blockStart > 0 && compression.level != 0) {
+            size_t dictionarySize = GS::Min (DictionarySize, blockStart);
+            success = tdefl_compress_buffer (compressor, data + blockStart - dictionarySize, dictionarySize, TDEFL_SYNC_FLUSH) == TDEFL_STATUS_OKAY;
+            compressedBlock.output.clear ();
+        }
+
+        // Every block but the last ends with a sync flush, so the blocks form a single deflate stream
+        tdefl_flush flush = isLastBlock ? TDEFL_FINISH : TDEFL_SYNC_FLUSH;
+        tdefl_status expectedStatus = isLastBlock ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY;
+        success = success && tdefl_compress_buffer (compressor, data + blockStart, blockSize, flush) == expectedStatus;
+        if (!success) {
+            compressedBlock.output.clear ();
+        }
+        compressedBlock.checksum = success ? (UInt32) mz_adler32 (MZ_ADLER32_INIT, data + blockStart, blockSize) : 0;
+    };
+
+    // A failed compression or write stops the pipeline, the rest of the blocks would be compressed for nothing
+    auto finalStage = [&](size_t blockIndex, UInt32 slotIndex) {
+        const CompressedBlock& compressedBlock = compressedBlocks[slotIndex];
+        size_t blockSize = GS::Min (InputBlockSize, size - blockIndex * InputBlockSize);
+        if (compressedBlock.output.empty () || !file.Write (compressedBlock.output.data (), compressedBlock.output.size ())) {
+            failed = true;
+            pipeline.Stop ();
+            return;
+        }
+        checksum = CombineAdler32 (checksum, compressedBlock.checksum, blockSize);
+        compressedSize += compressedBlock.output.size ();
+    };
+
+    PipelineStatistics pipelineStatistics;
+    pipeline.Run (blockCount, std::vector<size_t> (), hostStage, workerStage, finalStage, pipelineStatistics);
+    if (failed) {
+        return false;
+    }
+
+    const std::uint8_t checksumBytes[4] = {
+        (std::uint8_t) (checksum >> 24),
+        (std::uint8_t) (checksum >> 16),
+        (std::uint8_t) (checksum >> 8),
+        (std::uint8_t) checksum
+    };
+    compressedSize += sizeof (checksumBytes);
+    return file.Write (checksumBytes, sizeof (checksumBytes)) && file.Commit ();
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Definitions.hpp>
+#include <Location.hpp>
+
+#include "FragmentsSettings.hpp"
+
+// Deflates samples of the buffer with a few settings from the fastest to the smallest, and picks the
+// one with the smallest output whose projected time for the whole buffer fits in the time budget in
+// seconds. The time of the trials counts against the budget. If none fits, the fastest one is used.
+CompressionSettings ChooseCompressionSettings (const std::uint8_t* data, size_t size, UInt32 threadCount, double timeBudget, UInt64& trialTime);
+
+// Deflates a buffer into a zlib stream and writes it to a file. The buffer is cut into blocks that
+// are deflated on the worker threads, each with the end of the previous block as its dictionary,
+// and joined with sync flushes, like pigz does. The blocks are written in order on a writer thread
+// while the next ones are compressed, so the extra memory is bounded by the blocks in flight. The
+// file is written next to the destination and replaces it only when it is complete.
+bool WriteCompressedFile (const IO::Location& location, const std::uint8_t* data, size_t size, const CompressionSettings& compression, UInt32 threadCount, UInt64& compressedSize, UInt64& blockCount);
@@ -0,0 +1,69 @@
+#include "ElementGeometry.hpp"
+
+void ShellGeometry::RemoveUnusedPoints ()
+{
+    std::vector<bool> usedPoints (points.size (), false);
+    for (uint16_t pointIndex : profileIndices) {
+        usedPoints[pointIndex] = true;
+    }
+    for (uint16_t pointIndex : holeIndices) {
+        usedPoints[pointIndex] = true;
+    }
+
+    std::vector<uint16_t> newPointIndices (points.size (), 0);
+    std::vector<Vector3D> usedPositions;
+    usedPositions.reserve (points.size ());
+    min = Vector3D (MaxDouble, MaxDouble, MaxDouble);
+    max = Vector3D (-MaxDouble, -MaxDouble, -MaxDouble);
+    for (size_t pointIndex = 0; pointIndex < points.size (); ++pointIndex) {
+        if (!usedPoints[pointIndex]) {
+            continue;
+        }
+        const Vector3D& point = points[pointIndex];
+        newPointIndices[pointIndex] = (uint16_t) usedPositions.size ();
+        usedPositions.push_back (point);
+        min = Vector3D (GS::Min (min.x, point.x), GS::Min (min.y, point.y), GS::Min (min.z, point.z));
+        max = Vector3D (GS::Max (max.x, point.x), GS::Max (max.y, point.y), GS::Max (max.z, point.z));
+    }
+    if (usedPositions.size () == points.size ()) {
+        return;
+    }
+
+    for (uint16_t& pointIndex : profileIndices) {
+        pointIndex = newPointIndices[pointIndex];
+    }
+    for (uint16_t& pointIndex : holeIndices) {
+        pointIndex = newPointIndices[pointIndex];
+    }
+    points.swap (usedPositions);
+}
+
+static void ExtendBoundingBox (Vector3D& min, Vector3D& max, const Vector3D& boxMin, const Vector3D& boxMax)
+{
+    min.x = GS::Min (min.x, boxMin.x);
+    min.y = GS::Min (min.y, boxMin.y);
+    min.z = GS::Min (min.z, boxMin.z);
+    max.x = GS::Max (max.x, boxMax.x);
+    max.y = GS::Max (max.y, boxMax.y);
+    max.z = GS::Max (max.z, boxMax.z);
+}
+
+void ElementGeometry::ComputeBoundingBox ()
+{
+    min = Vector3D (MaxDouble, MaxDouble, MaxDouble);
+    max = Vector3D (-MaxDouble, -MaxDouble, -MaxDouble);
+    for (const ShellGeometry& shell : shells) {
+        ExtendBoundingBox (min, max, shell.min, shell.max);
+    }
+    for (const CircleExtrusionGeometry& circleExtrusion : circleExtrusions) {
+        ExtendBoundingBox (min, max, circleExtrusion.min, circleExtrusion.max);
+    }
+}
+
+Vector3D ElementGeometry::GetCenter () const
+{
+    if (min.x > max.x) {
+        return Vector3D (0.0, 0.0, 0.0);
+    }
+    return Vector3D ((min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <AttributeIndex.hpp>
+#include <Transformation3D.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+#include "Schema/index_generated.h"
+
+// Orthonormal frame of shell points: world = origin + x * xDirection + y * yDirection + z * zDirection.
+class ShellFrame
+{
+public:
+    ShellFrame () :
+        origin (0.0, 0.0, 0.0),
+        xDirection (1.0, 0.0, 0.0),
+        yDirection (0.0, 1.0, 0.0),
+        zDirection (0.0, 0.0, 1.0)
+    {
+
+    }
+
+    Vector3D origin;
+    Vector3D xDirection;
+    Vector3D yDirection;
+    Vector3D zDirection;
+};
+
+// Per-material shell extracted from an element, not yet written to the builder.
+class ShellGeometry
+{
+public:
+    ShellGeometry (const ModelerAPI::AttributeIndex& materialIndex) :
+        materialIndex (materialIndex),
+        points (),
+        profileIndices (),
+        profileSizes (),
+        holeIndices (),
+        holeSizes (),
+        holeProfiles (),
+        min (MaxDouble, MaxDouble, MaxDouble),
+        max (-MaxDouble, -MaxDouble, -MaxDouble),
+        hasLocalFrame (false),
+        localFrame (),
+        instanceHash (0)
+    {
+
+    }
+
+    // Drops the points not referenced by any profile or hole, keeps the order of the
+    // remaining ones and recalculates the bounding box.
+    void RemoveUnusedPoints ();
+
+    ModelerAPI::AttributeIndex materialIndex;
+    std::vector<Vector3D> points; // double precision, converted to float on serialization
+    std::vector<uint16_t> profileIndices;
+    std::vector<uint32_t> profileSizes;
+    std::vector<uint16_t> holeIndices;
+    std::vector<uint32_t> holeSizes;
+    std::vector<uint16_t> holeProfiles; // index of the profile containing the hole
+    Vector3D min;
+    Vector3D max;
+
+    bool hasLocalFrame;
+    ShellFrame localFrame;
+    size_t instanceHash;
+};
+
+enum class AxisPartType
+{
+    Wire,
+    CircleCurve
+};
+
+// Segment of a circle extrusion axis. Wires go from start to end, circle curves
+// are center + radius * (cos (t) * xDirection + sin (t) * yDirection) for t in [0, aperture].
+class AxisPartGeometry
+{
+public:
+    AxisPartGeometry () :
+        type (AxisPartType::Wire),
+        start (0.0, 0.0, 0.0),
+        end (0.0, 0.0, 0.0),
+        center (0.0, 0.0, 0.0),
+        radius (0.0),
+        aperture (0.0),
+        xDirection (1.0, 0.0, 0.0),
+        yDirection (0.0, 1.0, 0.0)
+    {
+
+    }
+
+    AxisPartType type;
+    Vector3D start;
+    Vector3D end;
+    Vector3D center;
+    double radius;
+    double aperture;
+    Vector3D xDirection;
+    Vector3D yDirection;
+};
+
+// Circular profile swept along an axis, recognized from a tessellated tube.
+class CircleExtrusionGeometry
+{
+public:
+    CircleExtrusionGeometry (const ModelerAPI::AttributeIndex& materialIndex) :
+        materialIndex (materialIndex),
+        radius (0.0),
+        axisParts (),
+        min (MaxDouble, MaxDouble, MaxDouble),
+        max (-MaxDouble, -MaxDouble, -MaxDouble)
+    {
+
+    }
+
+    ModelerAPI::AttributeIndex materialIndex;
+    double radius;
+    std::vector<AxisPartGeometry> axisParts;
+    Vector3D min;
+    Vector3D max;
+};
+
+class ElementGeometry
+{
+public:
+    ElementGeometry () :
+        shells (),
+        circleExtrusions (),
+        min (MaxDouble, MaxDouble, MaxDouble),
+        max (-MaxDouble, -MaxDouble, -MaxDouble),
+        weldedPointCount (0),
+        decimatedPointCount (0),
+        mergedProfileCount (0),
+        replacedPointCount (0),
+        indexDeltaSumBefore (0),
+        indexDeltaSumAfter (0)
+    {
+
+    }
+
+    // World bounding box of the shells and circle extrusions. It has to be computed
+    // before the shells are moved to their local frames.
+    void ComputeBoundingBox ();
+    Vector3D GetCenter () const;
+
+    std::vector<ShellGeometry> shells;
+    std::vector<CircleExtrusionGeometry> circleExtrusions;
+    Vector3D min;
+    Vector3D max;
+    size_t weldedPointCount;
+    size_t decimatedPointCount;
+    size_t mergedProfileCount;
+    size_t replacedPointCount;
+    size_t indexDeltaSumBefore;
+    size_t indexDeltaSumAfter;
+};
+
+namespace std
+{
+
+template <>
+struct hash<ModelerAPI::AttributeIndex>
+{
+    size_t operator() (const ModelerAPI::AttributeIndex& val) const noexcept
+    {
+        return val.GenerateHashValue ();
+    }
+};
+
+}
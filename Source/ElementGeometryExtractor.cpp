@@ -0,0 +1,259 @@
+#include "ElementGeometryExtractor.hpp"
+
+#include <ConvexPolygon.hpp>
+
+#include <algorithm>
+
+#include "CircleExtrusionRecognition.hpp"
+#include "MeshDecimation.hpp"
+#include "PolygonReconstruction.hpp"
+#include "ShellInstancing.hpp"
+#include "ShellReordering.hpp"
+#include "VertexWelding.hpp"
+
+static Geometry::Transformation3D SetUpVectorToY = Geometry::Transformation3D::CreateRotationX (-PI * 0.5);
+
+// Profile indices are 16-bit, and 0xFFFF is the primitive restart index of 16-bit index buffers
+static const size_t MaxShellPointCount = 0xFFFF;
+
+// Collects the vertex offsets of the convex pieces of the polygon into the material bucket
+static void AddPolygonProfiles (const ModelerAPI::Polygon& polygon, UInt32 bodyIndex, ElementPolygons& polygons, std::vector<ProfileReference>& profiles)
+{
+    for (Int32 convexPolygonIndex = 1; convexPolygonIndex <= polygon.GetConvexPolygonCount (); ++convexPolygonIndex) {
+        ModelerAPI::ConvexPolygon convexPolygon;
+        polygon.GetConvexPolygon (convexPolygonIndex, &convexPolygon);
+        UInt32 firstVertex = (UInt32) polygons.profileVertices.size ();
+        for (Int32 vertexIndex = 1; vertexIndex <= convexPolygon.GetVertexCount (); vertexIndex++) {
+            polygons.profileVertices.push_back (convexPolygon.GetVertexIndex (vertexIndex) - 1);
+        }
+        profiles.push_back (ProfileReference (bodyIndex, firstVertex, (UInt32) polygons.profileVertices.size () - firstVertex));
+    }
+}
+
+static void AddProfileToShell (const std::vector<Vector3D>& positions, const Int32* bodyVertexOffsets, UInt32 vertexCount, BodyVertexRemap& remap, UInt32 shellStamp, ShellGeometry& shell)
+{
+    for (UInt32 vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        Int32 bodyVertexOffset = bodyVertexOffsets[vertexIndex];
+        if (remap.shells[bodyVertexOffset] != shellStamp) {
+            const Vector3D& position = positions[bodyVertexOffset];
+            remap.shells[bodyVertexOffset] = shellStamp;
+            remap.points[bodyVertexOffset] = (uint16_t) shell.points.size ();
+            shell.points.push_back (position);
+
+            shell.min.x = GS::Min (shell.min.x, position.x);
+            shell.min.y = GS::Min (shell.min.y, position.y);
+            shell.min.z = GS::Min (shell.min.z, position.z);
+            shell.max.x = GS::Max (shell.max.x, position.x);
+            shell.max.y = GS::Max (shell.max.y, position.y);
+            shell.max.z = GS::Max (shell.max.z, position.z);
+        }
+        shell.profileIndices.push_back (remap.points[bodyVertexOffset]);
+    }
+    shell.profileSizes.push_back (vertexCount);
+}
+
+ElementPolygons::ElementPolygons () :
+    bodyPositions (),
+    materials (),
+    profilesByMaterial (),
+    profileVertices (),
+    visiblePolygonCount (0)
+{
+
+}
+
+void ElementPolygons::Clear ()
+{
+    for (size_t materialBucket = 0; materialBucket < materials.size (); ++materialBucket) {
+        profilesByMaterial[materialBucket].clear ();
+    }
+    for (std::vector<Vector3D>& positions : bodyPositions) {
+        positions.clear ();
+    }
+    materials.clear ();
+    profileVertices.clear ();
+    visiblePolygonCount = 0;
+}
+
+ElementPolygonReader::ElementPolygonReader () :
+    materialBuckets ()
+{
+
+}
+
+void ElementPolygonReader::Read (const ModelerAPI::Element& element, ElementPolygons& polygons)
+{
+    polygons.Clear ();
+    materialBuckets.clear ();
+
+    Int32 bodyCount = element.GetTessellatedBodyCount ();
+    polygons.bodyPositions.resize (bodyCount);
+    for (Int32 bodyIndex = 1; bodyIndex <= bodyCount; ++bodyIndex) {
+        ModelerAPI::MeshBody body;
+        element.GetTessellatedBody (bodyIndex, &body);
+        UInt32 bodyPolygonCount = polygons.visiblePolygonCount;
+        for (Int32 polygonIndex = 1; polygonIndex <= body.GetPolygonCount (); ++polygonIndex) {
+            ModelerAPI::Polygon polygon;
+            body.GetPolygon (polygonIndex, &polygon);
+            if (polygon.IsInvisible ()) {
+                continue;
+            }
+            ModelerAPI::AttributeIndex materialIndex;
+            polygon.GetMaterialIndex (materialIndex);
+            auto found = materialBuckets.find (materialIndex);
+            size_t materialBucket = 0;
+            if (found == materialBuckets.end ()) {
+                materialBucket = polygons.materials.size ();
+                materialBuckets.insert ({ materialIndex, materialBucket });
+                polygons.materials.push_back (materialIndex);
+                if (polygons.profilesByMaterial.size () < polygons.materials.size ()) {
+                    polygons.profilesByMaterial.emplace_back ();
+                }
+            } else {
+                materialBucket = found->second;
+            }
+            AddPolygonProfiles (polygon, bodyIndex - 1, polygons, polygons.profilesByMaterial[materialBucket]);
+            polygons.visiblePolygonCount += 1;
+        }
+        if (polygons.visiblePolygonCount == bodyPolygonCount) {
+            continue;
+        }
+
+        std::vector<Vector3D>& positions = polygons.bodyPositions[bodyIndex - 1];
+        Int32 vertexCount = body.GetVertexCount ();
+        positions.resize (vertexCount);
+        for (Int32 vertexIndex = 1; vertexIndex <= vertexCount; ++vertexIndex) {
+            ModelerAPI::Vertex vertex;
+            body.GetVertex (vertexIndex, &vertex, ModelerAPI::CoordinateSystem::World);
+            positions[vertexIndex - 1] = SetUpVectorToY.Apply_V (Vector3D (vertex.x, vertex.y, vertex.z));
+        }
+    }
+}
+
+BodyVertexRemap::BodyVertexRemap () :
+    shells (),
+    points ()
+{
+
+}
+
+void BodyVertexRemap::Grow (size_t vertexCount)
+{
+    if (shells.size () < vertexCount) {
+        shells.resize (vertexCount, 0);
+        points.resize (vertexCount, 0);
+    }
+}
+
+ElementGeometryExtractor::ElementGeometryExtractor (const FragmentsExportSettings& settings) :
+    settings (settings),
+    bodyRemaps (),
+    remapStamp (0)
+{
+
+}
+
+void ElementGeometryExtractor::Extract (const ElementPolygons& polygons, const DecimationSettings& decimation, ElementGeometry& geometry)
+{
+    bodyRemaps.resize (polygons.bodyPositions.size ());
+    for (size_t bodyIndex = 0; bodyIndex < polygons.bodyPositions.size (); ++bodyIndex) {
+        bodyRemaps[bodyIndex].Grow (polygons.bodyPositions[bodyIndex].size ());
+    }
+
+    geometry.shells.reserve (polygons.materials.size ());
+    for (size_t materialBucket = 0; materialBucket < polygons.materials.size (); ++materialBucket) {
+        bool split = CountShellPoints (polygons, polygons.profilesByMaterial[materialBucket]) > MaxShellPointCount;
+        AddShells (polygons, materialBucket, split, geometry);
+    }
+
+    if (settings.weldTolerance > 0.0) {
+        for (ShellGeometry& shell : geometry.shells) {
+            geometry.weldedPointCount += WeldShellPoints (shell, settings.weldTolerance);
+        }
+        geometry.shells.erase (std::remove_if (geometry.shells.begin (), geometry.shells.end (), [](const ShellGeometry& shell) {
+            return shell.points.empty ();
+        }), geometry.shells.end ());
+    }
+
+    if (decimation.IsEnabled ()) {
+        for (ShellGeometry& shell : geometry.shells) {
+            geometry.decimatedPointCount += DecimateShell (shell, decimation);
+        }
+    }
+
+    if (settings.reconstructPolygons) {
+        geometry.mergedProfileCount += ReconstructShellPolygons (geometry.shells);
+    }
+
+    if (settings.circleExtrusionTolerance > 0.0) {
+        for (ShellGeometry& shell : geometry.shells) {
+            geometry.replacedPointCount += ExtractCircleExtrusions (shell, settings.circleExtrusionTolerance, geometry.circleExtrusions);
+        }
+        geometry.shells.erase (std::remove_if (geometry.shells.begin (), geometry.shells.end (), [](const ShellGeometry& shell) {
+            return shell.points.empty ();
+        }), geometry.shells.end ());
+    }
+
+    geometry.ComputeBoundingBox ();
+    if (settings.geometryInstancing) {
+        for (ShellGeometry& shell : geometry.shells) {
+            CanonicalizeShell (shell);
+        }
+    }
+
+    // After the canonicalization, so instances see their points in the same local frame
+    // and end up in the same order
+    if (settings.reorderShells) {
+        for (ShellGeometry& shell : geometry.shells) {
+            ReorderShell (shell, geometry.indexDeltaSumBefore, geometry.indexDeltaSumAfter);
+        }
+    }
+}
+
+// The remap stamps mark the vertices counted so far, so a shared vertex is counted once
+size_t ElementGeometryExtractor::CountShellPoints (const ElementPolygons& polygons, const std::vector<ProfileReference>& profiles)
+{
+    UInt32 countStamp = GetNextRemapStamp ();
+    size_t pointCount = 0;
+    for (const ProfileReference& profile : profiles) {
+        BodyVertexRemap& remap = bodyRemaps[profile.bodyIndex];
+        const Int32* bodyVertexOffsets = &polygons.profileVertices[profile.firstVertex];
+        for (UInt32 vertexIndex = 0; vertexIndex < profile.vertexCount; ++vertexIndex) {
+            Int32 bodyVertexOffset = bodyVertexOffsets[vertexIndex];
+            if (remap.shells[bodyVertexOffset] != countStamp) {
+                remap.shells[bodyVertexOffset] = countStamp;
+                pointCount += 1;
+            }
+        }
+    }
+    return pointCount;
+}
+
+// After a wrap-around the old stamps could match again, so they are cleared
+UInt32 ElementGeometryExtractor::GetNextRemapStamp ()
+{
+    if (remapStamp == (UInt32) -1) {
+        for (BodyVertexRemap& remap : bodyRemaps) {
+            std::fill (remap.shells.begin (), remap.shells.end (), 0);
+        }
+        remapStamp = 0;
+    }
+    return ++remapStamp;
+}
+
+// With splitting a new shell is started when the next profile might not fit, so the profiles are
+// streamed in their original order, which is spatially coherent for tessellated surfaces
+void ElementGeometryExtractor::AddShells (const ElementPolygons& polygons, size_t materialBucket, bool split, ElementGeometry& geometry)
+{
+    size_t firstShell = geometry.shells.size ();
+    UInt32 shellStamp = 0;
+    for (const ProfileReference& profile : polygons.profilesByMaterial[materialBucket]) {
+        bool shellFull = split && geometry.shells.back ().points.size () + profile.vertexCount > MaxShellPointCount;
+        if (geometry.shells.size () == firstShell || shellFull) {
+            geometry.shells.emplace_back (polygons.materials[materialBucket]);
+            shellStamp = GetNextRemapStamp ();
+        }
+        const Int32* bodyVertexOffsets = &polygons.profileVertices[profile.firstVertex];
+        AddProfileToShell (polygons.bodyPositions[profile.bodyIndex], bodyVertexOffsets, profile.vertexCount, bodyRemaps[profile.bodyIndex], shellStamp, geometry.shells.back ());
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <ModelElement.hpp>
+#include <ModelMeshBody.hpp>
+
+#include "ElementGeometry.hpp"
+#include "FragmentsSettings.hpp"
+
+// Convex piece of a visible polygon, its body vertex offsets are a range of profileVertices
+class ProfileReference
+{
+public:
+    ProfileReference (UInt32 bodyIndex, UInt32 firstVertex, UInt32 vertexCount) :
+        bodyIndex (bodyIndex),
+        firstVertex (firstVertex),
+        vertexCount (vertexCount)
+    {
+
+    }
+
+    UInt32 bodyIndex;
+    UInt32 firstVertex;
+    UInt32 vertexCount;
+};
+
+// Visible polygons of an element grouped by material, copied out of the ModelerAPI objects.
+// Only the bodies with visible polygons have their vertex positions filled.
+class ElementPolygons
+{
+public:
+    ElementPolygons ();
+
+    void Clear ();
+
+    std::vector<std::vector<Vector3D>> bodyPositions;
+    std::vector<ModelerAPI::AttributeIndex> materials;
+    std::vector<std::vector<ProfileReference>> profilesByMaterial;
+    std::vector<Int32> profileVertices;
+    UInt32 visiblePolygonCount;
+};
+
+// Reads the polygons of elements in a single pass over their tessellated bodies, every body
+// is fetched exactly once. The ModelerAPI is only called here, so the reader stays on the
+// calling thread and the extractors work on the copied data.
+class ElementPolygonReader
+{
+public:
+    ElementPolygonReader ();
+
+    // An element without visible polygons has visiblePolygonCount == 0 after this call
+    void Read (const ModelerAPI::Element& element, ElementPolygons& polygons);
+
+private:
+    std::unordered_map<ModelerAPI::AttributeIndex, size_t> materialBuckets;
+};
+
+// Dense remap from body vertex offset to shell point index. The entries are valid only if
+// they were written for the current shell, and the stamps of the shells keep increasing
+// across elements, so the entries never have to be cleared.
+class BodyVertexRemap
+{
+public:
+    BodyVertexRemap ();
+
+    // The new entries belong to no shell, the existing ones are kept
+    void Grow (size_t vertexCount);
+
+    std::vector<UInt32> shells;
+    std::vector<uint16_t> points;
+};
+
+// Builds the per-material shells of elements. The containers are kept between
+// elements to avoid reallocations, so every thread should use its own extractor.
+class ElementGeometryExtractor
+{
+public:
+    ElementGeometryExtractor (const FragmentsExportSettings& settings);
+
+    void Extract (const ElementPolygons& polygons, const DecimationSettings& decimation, ElementGeometry& geometry);
+
+private:
+    size_t CountShellPoints (const ElementPolygons& polygons, const std::vector<ProfileReference>& profiles);
+    void AddShells (const ElementPolygons& polygons, size_t materialBucket, bool split, ElementGeometry& geometry);
+    UInt32 GetNextRemapStamp ();
+
+    const FragmentsExportSettings& settings;
+
+    std::vector<BodyVertexRemap> bodyRemaps;
+    UInt32 remapStamp;
+};
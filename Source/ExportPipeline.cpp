@@ -0,0 +1,251 @@
+#include "ExportPipeline.hpp"
+#include "BoundedQueue.hpp"
+#include "SpinWait.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Slots per worker, enough to keep the workers fed while the final stage is on a slow item
+static const UInt32 SlotsPerWorker = 4;
+
+typedef std::chrono::steady_clock Clock;
+
+static UInt64 GetElapsedTime (Clock::time_point start)
+{
+    return (UInt64) std::chrono::duration_cast<std::chrono::microseconds> (Clock::now () - start).count ();
+}
+
+PipelineStatistics::PipelineStatistics () :
+    hostBusyTime (0),
+    hostStallTime (0),
+    workerBusyTime (0),
+    workerStallTime (0),
+    finalBusyTime (0),
+    finalStallTime (0),
+    occupancySum (0),
+    occupancySampleCount (0)
+{
+
+}
+
+ExportPipeline::ExportPipeline (UInt32 threadCount) :
+    workerCount (threadCount > 1 ? threadCount - 1 : 1),
+    slotCount (threadCount > 1 ? (threadCount - 1) * SlotsPerWorker : 1),
+    serial (threadCount <= 1),
+    stopped (false)
+{
+
+}
+
+UInt32 ExportPipeline::GetWorkerCount () const
+{
+    return workerCount;
+}
+
+UInt32 ExportPipeline::GetSlotCount () const
+{
+    return slotCount;
+}
+
+void ExportPipeline::Run (
+    size_t itemCount,
+    const std::vector<size_t>& priorityItems,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex)>& hostStage,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex, UInt32 workerIndex)>& workerStage,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex)>& finalStage,
+    PipelineStatistics& statistics)
+{
+    stopped.store (false);
+    if (serial) {
+        RunSerial (itemCount, hostStage, workerStage, finalStage, statistics);
+        return;
+    }
+
+    // The priority items come first, the others follow in item order. Every other slot stays
+    // available for the items in order, so the final stage always gets the item it waits for.
+    std::vector<size_t> startOrder;
+    std::vector<bool> prioritized (itemCount, false);
+    startOrder.reserve (itemCount);
+    for (size_t itemIndex : priorityItems) {
+        if (startOrder.size () < workerCount && itemIndex < itemCount && !prioritized[itemIndex]) {
+            prioritized[itemIndex] = true;
+            startOrder.push_back (itemIndex);
+        }
+    }
+    for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex) {
+        if (!prioritized[itemIndex]) {
+            startOrder.push_back (itemIndex);
+        }
+    }
+
+    // The host takes a free slot for the item and records it in itemSlots, and hands the item
+    // index to the workers through the queue. A worker marks its item done in the slot, and the
+    // final stage frees the slot once it has finished the item. An item is in at most one place
+    // at a time, so neither queue ever holds more than slotCount items.
+    static const UInt32 NoSlot = (UInt32) -1;
+    BoundedQueue<size_t> workQueue (slotCount);
+    BoundedQueue<UInt32> freeSlots (slotCount);
+    std::unique_ptr<std::atomic<size_t>[]> slotDoneItems (new std::atomic<size_t>[slotCount]);
+    for (UInt32 slotIndex = 0; slotIndex < slotCount; ++slotIndex) {
+        slotDoneItems[slotIndex].store (0, std::memory_order_relaxed);
+        freeSlots.TryPush (slotIndex);
+    }
+    std::unique_ptr<std::atomic<UInt32>[]> itemSlots (new std::atomic<UInt32>[itemCount]);
+    for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex) {
+        itemSlots[itemIndex].store (NoSlot, std::memory_order_relaxed);
+    }
+    std::atomic<size_t> finishedItemCount (0);
+    std::atomic<bool> hostFinished (false);
+
+    std::mutex exceptionMutex;
+    std::exception_ptr firstException;
+    auto abort = [&]() {
+        std::lock_guard<std::mutex> lock (exceptionMutex);
+        if (firstException == nullptr) {
+            firstException = std::current_exception ();
+        }
+        stopped.store (true);
+    };
+
+    std::vector<UInt64> workerBusyTimes (workerCount, 0);
+    std::vector<UInt64> workerStallTimes (workerCount, 0);
+    auto worker = [&](UInt32 workerIndex) {
+        try {
+            while (true) {
+                size_t itemIndex = 0;
+                bool popped = false;
+                workerStallTimes[workerIndex] += WaitFor ([&]() {
+                    if (stopped.load (std::memory_order_relaxed)) {
+                        return true;
+                    }
+                    // The flag is read before trying the queue, so nothing can be pushed after a failed pop
+                    bool hostDone = hostFinished.load (std::memory_order_acquire);
+                    popped = workQueue.TryPop (itemIndex);
+                    return popped || hostDone;
+                });
+                if (!popped) {
+                    break;
+                }
+                Clock::time_point start = Clock::now ();
+                UInt32 slotIndex = itemSlots[itemIndex].load (std::memory_order_relaxed);
+                workerStage (itemIndex, slotIndex, workerIndex);
+                slotDoneItems[slotIndex].store (itemIndex + 1, std::memory_order_release);
+                workerBusyTimes[workerIndex] += GetElapsedTime (start);
+            }
+        } catch (...) {
+            abort ();
+        }
+    };
+
+    auto finalizer = [&]() {
+        try {
+            for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex) {
+                UInt32 slotIndex = NoSlot;
+                statistics.finalStallTime += WaitFor ([&]() {
+                    slotIndex = itemSlots[itemIndex].load (std::memory_order_acquire);
+                    return (slotIndex != NoSlot && slotDoneItems[slotIndex].load (std::memory_order_acquire) == itemIndex + 1) || stopped.load (std::memory_order_relaxed);
+                });
+                if (stopped.load (std::memory_order_relaxed)) {
+                    break;
+                }
+                Clock::time_point start = Clock::now ();
+                finalStage (itemIndex, slotIndex);
+                finishedItemCount.store (itemIndex + 1, std::memory_order_release);
+                freeSlots.TryPush (slotIndex);
+                statistics.finalBusyTime += GetElapsedTime (start);
+            }
+        } catch (...) {
+            abort ();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (UInt32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        threads.emplace_back (worker, workerIndex);
+    }
+    threads.emplace_back (finalizer);
+
+    try {
+        for (size_t startIndex = 0; startIndex < itemCount; ++startIndex) {
+            size_t itemIndex = startOrder[startIndex];
+            UInt32 slotIndex = NoSlot;
+            statistics.hostStallTime += WaitFor ([&]() {
+                return freeSlots.TryPop (slotIndex) || stopped.load (std::memory_order_relaxed);
+            });
+            if (stopped.load (std::memory_order_relaxed)) {
+                break;
+            }
+            statistics.occupancySum += startIndex - finishedItemCount.load (std::memory_order_relaxed);
+            statistics.occupancySampleCount += 1;
+
+            Clock::time_point start = Clock::now ();
+            hostStage (itemIndex, slotIndex);
+            statistics.hostBusyTime += GetElapsedTime (start);
+            itemSlots[itemIndex].store (slotIndex, std::memory_order_release);
+            while (!workQueue.TryPush (itemIndex)) {
+                std::this_thread::yield ();
+            }
+        }
+    } catch (...) {
+        abort ();
+    }
+    hostFinished.store (true, std::memory_order_release);
+
+    for (std::thread& thread : threads) {
+        thread.join ();
+    }
+    for (UInt32 workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        statistics.workerBusyTime += workerBusyTimes[workerIndex];
+        statistics.workerStallTime += workerStallTimes[workerIndex];
+    }
+
+    if (firstException != nullptr) {
+        std::rethrow_exception (firstException);
+    }
+}
+
+void ExportPipeline::RunSerial (
+    size_t itemCount,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex)>& hostStage,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex, UInt32 workerIndex)>& workerStage,
+    const std::function<void (size_t itemIndex, UInt32 slotIndex)>& finalStage,
+    PipelineStatistics& statistics)
+{
+    for (size_t itemIndex = 0; itemIndex < itemCount; ++itemIndex) {
+        Clock::time_point start = Clock::now ();
+        hostStage (itemIndex, 0);
+        statistics.hostBusyTime += GetElapsedTime (start);
+
+        start = Clock::now ();
+        workerStage (itemIndex, 0, 0);
+        statistics.workerBusyTime += GetElapsedTime (start);
+
+        start = Clock::now ();
+        finalStage (itemIndex, 0);
+        statistics.finalBusyTime += GetElapsedTime (start);
+
+        statistics.occupancySum += 1;
+        statistics.occupancySampleCount += 1;
+        if (stopped.load ()) {
+            break;
+        }
+    }
+}
+
+void ExportPipeline::Stop ()
+{
+    stopped.store (true);
+}
+
+UInt32 GetExportThreadCount (Int32 requestedThreadCount)
+{
+    if (requestedThreadCount > 0) {
+        return (UInt32) requestedThreadCount;
+    }
+    return GS::Max (std::thread::hardware_concurrency (), 1u);
+}
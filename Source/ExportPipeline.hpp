@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Definitions.hpp>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+class PipelineStatistics
+{
+public:
+    PipelineStatistics ();
+
+    // Times in microseconds, the worker times are summed over the worker threads
+    UInt64 hostBusyTime;
+    UInt64 hostStallTime;
+    UInt64 workerBusyTime;
+    UInt64 workerStallTime;
+    UInt64 finalBusyTime;
+    UInt64 finalStallTime;
+
+    // Items in flight, sampled every time the host stage starts an item
+    UInt64 occupancySum;
+    UInt64 occupancySampleCount;
+};
+
+// Three stage pipeline with a bounded number of items in flight. The host stage runs on the
+// calling thread in start order, the worker stage on the worker threads in any order, and the
+// final stage on its own thread in item order. An item keeps its slot in every stage, so
+// per-item data can be stored in an array of GetSlotCount () elements. The stages hand items
+// over through lock-free queues and per-slot flags, a stage without work spins shortly and
+// then sleeps. With a single thread the stages run one after another on the calling thread.
+class ExportPipeline
+{
+public:
+    ExportPipeline (UInt32 threadCount);
+
+    UInt32 GetWorkerCount () const;
+    UInt32 GetSlotCount () const;
+
+    // The start order is the item order, except that the priorityItems are started first, so a
+    // long item does not end up alone at the end of the run. A started item holds its slot until
+    // the final stage reaches it, so at most GetWorkerCount () of them are taken. The serial run
+    // ignores them. Exceptions of any stage stop the pipeline and are rethrown after all threads
+    // have finished.
+    void Run (
+        size_t itemCount,
+        const std::vector<size_t>& priorityItems,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex)>& hostStage,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex, UInt32 workerIndex)>& workerStage,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex)>& finalStage,
+        PipelineStatistics& statistics);
+
+    // Can be called from any stage when the rest of the items is not needed. No more items are
+    // started, the ones in the worker stage finish, and Run returns without running the final
+    // stage of the remaining items.
+    void Stop ();
+
+private:
+    void RunSerial (
+        size_t itemCount,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex)>& hostStage,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex, UInt32 workerIndex)>& workerStage,
+        const std::function<void (size_t itemIndex, UInt32 slotIndex)>& finalStage,
+        PipelineStatistics& statistics);
+
+    UInt32 workerCount;
+    UInt32 slotCount;
+    bool serial;
+    std::atomic<bool> stopped;
+};
+
+// The requested thread count if positive, the number of hardware threads otherwise
+UInt32 GetExportThreadCount (Int32 requestedThreadCount);
@@ -0,0 +1,158 @@
+#include "ExportStatistics.hpp"
+
+#include <ACAPinc.h>
+
+ExportStatistics::ExportStatistics () :
+    bodyFetchCount (0),
+    skippedElementCount (0),
+    sampleCount (0),
+    instancedSampleCount (0),
+    instancingSavedBytes (0),
+    pointCount (0),
+    weldedPointCount (0),
+    decimatedPointCount (0),
+    profileCount (0),
+    holeCount (0),
+    mergedProfileCount (0),
+    circleExtrusionCount (0),
+    replacedPointCount (0),
+    indexDeltaSumBefore (0),
+    indexDeltaSumAfter (0),
+    coordinateGridSize (0.0),
+    maxCoordinateError (0.0),
+    sharedCategoryCount (0),
+    sharedCategoryBytes (0),
+    sharedAttributeCount (0),
+    sharedAttributeBytes (0),
+    sharedAttributeTableCount (0),
+    sharedAttributeTableBytes (0),
+    propertyCacheHitCount (0),
+    propertyCacheMissCount (0),
+    pipelineWorkerCount (0),
+    pipelineSlotCount (0),
+    pipelineOccupancySum (0),
+    pipelineOccupancySampleCount (0),
+    hostStageBusyTime (0),
+    hostStageStallTime (0),
+    workerStageBusyTime (0),
+    workerStageStallTime (0),
+    finalStageBusyTime (0),
+    finalStageStallTime (0),
+    bufferSize (0),
+    bufferReallocationCount (0),
+    bufferPeakSize (0),
+    compressionLevel (0),
+    compressionStrategy (0),
+    compressionTrialTime (0),
+    compressedBlockCount (0),
+    outputSize (0)
+{
+
+}
+
+static void WriteReport (const GS::UniString& report)
+{
+    ACAPI_WriteReport (report, false);
+}
+
+static double GetPercentage (UInt64 value, UInt64 total)
+{
+    return total > 0 ? (double) value * 100.0 / (double) total : 0.0;
+}
+
+static const char* GetCompressionStrategyName (UInt64 strategy)
+{
+    static const char* strategyNames[] = { "default", "filtered", "run length" };
+    return strategy < sizeof (strategyNames) / sizeof (strategyNames[0]) ? strategyNames[strategy] : "unknown";
+}
+
+static void WriteStageStatistics (const char* stageName, UInt64 busyTime, UInt64 stallTime, const char* stallReason)
+{
+    WriteReport (GS::UniString::Printf ("%s stage: busy %.1f ms (%.1f%%), stalled %.1f ms %s",
+        stageName,
+        (double) busyTime / 1000.0,
+        GetPercentage (busyTime, busyTime + stallTime),
+        (double) stallTime / 1000.0,
+        stallReason
+    ));
+}
+
+void WriteExportStatistics (const ExportStatistics& statistics)
+{
+    WriteReport ("--- fragments export ---");
+    WriteReport (GS::UniString::Printf ("tessellated body fetches: %llu, elements without visible geometry: %llu",
+        (unsigned long long) statistics.bodyFetchCount,
+        (unsigned long long) statistics.skippedElementCount
+    ));
+    WriteReport (GS::UniString::Printf ("samples: %llu, instanced: %llu (%.1f%%), bytes saved by instancing: %lld",
+        (unsigned long long) statistics.sampleCount,
+        (unsigned long long) statistics.instancedSampleCount,
+        GetPercentage (statistics.instancedSampleCount, statistics.sampleCount),
+        (long long) statistics.instancingSavedBytes
+    ));
+    WriteReport (GS::UniString::Printf ("points: %llu, removed by welding: %llu, removed by decimation: %llu",
+        (unsigned long long) statistics.pointCount,
+        (unsigned long long) statistics.weldedPointCount,
+        (unsigned long long) statistics.decimatedPointCount
+    ));
+    WriteReport (GS::UniString::Printf ("profiles: %llu, holes: %llu, removed by polygon reconstruction: %llu",
+        (unsigned long long) statistics.profileCount,
+        (unsigned long long) statistics.holeCount,
+        (unsigned long long) statistics.mergedProfileCount
+    ));
+    WriteReport (GS::UniString::Printf ("circle extrusions: %llu, shell points replaced by them: %llu",
+        (unsigned long long) statistics.circleExtrusionCount,
+        (unsigned long long) statistics.replacedPointCount
+    ));
+    WriteReport (GS::UniString::Printf ("shell index deltas: %llu before reordering, %llu after (%.1f%%)",
+        (unsigned long long) statistics.indexDeltaSumBefore,
+        (unsigned long long) statistics.indexDeltaSumAfter,
+        GetPercentage (statistics.indexDeltaSumAfter, statistics.indexDeltaSumBefore)
+    ));
+    // Without snapping the error is the float rounding and the deviation of the instanced shells
+    WriteReport (GS::UniString::Printf ("coordinate grid: %.4f mm, max coordinate error: %.4f mm",
+        statistics.coordinateGridSize * 1000.0,
+        statistics.maxCoordinateError * 1000.0
+    ));
+    WriteReport (GS::UniString::Printf ("shared category strings: %llu (%llu bytes saved), shared attribute strings: %llu (%llu bytes saved)",
+        (unsigned long long) statistics.sharedCategoryCount,
+        (unsigned long long) statistics.sharedCategoryBytes,
+        (unsigned long long) statistics.sharedAttributeCount,
+        (unsigned long long) statistics.sharedAttributeBytes
+    ));
+    WriteReport (GS::UniString::Printf ("shared attribute tables: %llu (%llu bytes saved)",
+        (unsigned long long) statistics.sharedAttributeTableCount,
+        (unsigned long long) statistics.sharedAttributeTableBytes
+    ));
+    WriteReport (GS::UniString::Printf ("IFC parent lookups: %llu cache hits, %llu misses",
+        (unsigned long long) statistics.propertyCacheHitCount,
+        (unsigned long long) statistics.propertyCacheMissCount
+    ));
+    // The stage that is busy while the others stall is the bottleneck
+    WriteReport (GS::UniString::Printf ("pipeline: %llu workers, %llu slots, average occupancy %.1f%%",
+        (unsigned long long) statistics.pipelineWorkerCount,
+        (unsigned long long) statistics.pipelineSlotCount,
+        GetPercentage (statistics.pipelineOccupancySum, statistics.pipelineOccupancySampleCount * statistics.pipelineSlotCount)
+    ));
+    WriteStageStatistics ("host", statistics.hostStageBusyTime, statistics.hostStageStallTime, "on a full pipeline");
+    WriteStageStatistics ("worker", statistics.workerStageBusyTime, statistics.workerStageStallTime, "without work");
+    WriteStageStatistics ("final", statistics.finalStageBusyTime, statistics.finalStageStallTime, "waiting for the workers");
+    WriteReport (GS::UniString::Printf ("flatbuffer size: %llu bytes, written: %llu bytes (%.1f%%)",
+        (unsigned long long) statistics.bufferSize,
+        (unsigned long long) statistics.outputSize,
+        GetPercentage (statistics.outputSize, statistics.bufferSize)
+    ));
+    if (statistics.compressedBlockCount > 0) {
+        WriteReport (GS::UniString::Printf ("compression level: %lld, strategy: %s, blocks: %llu, trials: %.1f ms",
+            (long long) statistics.compressionLevel,
+            GetCompressionStrategyName (statistics.compressionStrategy),
+            (unsigned long long) statistics.compressedBlockCount,
+            (double) statistics.compressionTrialTime / 1000.0
+        ));
+    }
+    WriteReport (GS::UniString::Printf ("flatbuffer reallocations: %llu, peak memory: %llu bytes (%.2fx the final size)",
+        (unsigned long long) statistics.bufferReallocationCount,
+        (unsigned long long) statistics.bufferPeakSize,
+        statistics.bufferSize > 0 ? (double) statistics.bufferPeakSize / (double) statistics.bufferSize : 0.0
+    ));
+}
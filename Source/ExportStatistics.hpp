@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Definitions.hpp>
+
+class ExportStatistics
+{
+public:
+    ExportStatistics ();
+
+    UInt64 bodyFetchCount;
+    UInt64 skippedElementCount;
+    UInt64 sampleCount;
+    UInt64 instancedSampleCount;
+    Int64 instancingSavedBytes;
+    UInt64 pointCount;
+    UInt64 weldedPointCount;
+    UInt64 decimatedPointCount;
+    UInt64 profileCount;
+    UInt64 holeCount;
+    UInt64 mergedProfileCount;
+    UInt64 circleExtrusionCount;
+    UInt64 replacedPointCount;
+    UInt64 indexDeltaSumBefore;
+    UInt64 indexDeltaSumAfter;
+    double coordinateGridSize;
+    double maxCoordinateError;
+    UInt64 sharedCategoryCount;
+    UInt64 sharedCategoryBytes;
+    UInt64 sharedAttributeCount;
+    UInt64 sharedAttributeBytes;
+    UInt64 sharedAttributeTableCount;
+    UInt64 sharedAttributeTableBytes;
+    UInt64 propertyCacheHitCount;
+    UInt64 propertyCacheMissCount;
+    UInt64 pipelineWorkerCount;
+    UInt64 pipelineSlotCount;
+    UInt64 pipelineOccupancySum;
+    UInt64 pipelineOccupancySampleCount;
+    UInt64 hostStageBusyTime;
+    UInt64 hostStageStallTime;
+    UInt64 workerStageBusyTime;
+    UInt64 workerStageStallTime;
+    UInt64 finalStageBusyTime;
+    UInt64 finalStageStallTime;
+    UInt64 bufferSize;
+    UInt64 bufferReallocationCount;
+    UInt64 bufferPeakSize;
+    Int64 compressionLevel;
+    UInt64 compressionStrategy;
+    UInt64 compressionTrialTime;
+    UInt64 compressedBlockCount;
+    UInt64 outputSize;
+};
+
+// Writes the statistics to the report window, only debug builds call it
+void WriteExportStatistics (const ExportStatistics& statistics);
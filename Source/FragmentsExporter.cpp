@@ -3,108 +3,160 @@
 #include <ModelElement.hpp>
 #include <ModelMeshBody.hpp>
 #include <ModelMaterial.hpp>
-#include <ConvexPolygon.hpp>
 #include <AttributeIndex.hpp>
 
-#include <File.hpp>
-
 #include <Transformation3D.hpp>
 
-#include <miniz.h>
+#include <algorithm>
+#include <cstring>
 
 #include "Schema/index_generated.h"
-#include "PropertyUtils.hpp"
+#include "IfcPropertyCache.hpp"
+#include "ExportPipeline.hpp"
+#include "ElementGeometry.hpp"
+#include "ElementGeometryExtractor.hpp"
+#include "AttributeJsonEncoder.hpp"
+#include "ShellInstancing.hpp"
+#include "ShellSerialization.hpp"
+#include "ModelBufferBuilder.hpp"
+#include "MappedFileAllocator.hpp"
+#include "CompressedFileWriter.hpp"
+#include "TemporaryFile.hpp"
 
 static const Transform IdentityTransform (DoubleVector (0.0, 0.0, 0.0), FloatVector (1.0f, 0.0f, 0.0f), FloatVector (0.0f, 1.0f, 0.0f));
-static Geometry::Transformation3D SetUpVectorToY = Geometry::Transformation3D::CreateRotationX (-PI * 0.5);
 
-class BodyVertex
+class ExportedElement
 {
 public:
-    BodyVertex (Int32 bodyIndex, Int32 vertexIndex) :
-        bodyIndex (bodyIndex),
-        vertexIndex (vertexIndex)
+    ExportedElement (Int32 elementIndex, const GS::Guid& elemGuid, Int32 bodyCount) :
+        elementIndex (elementIndex),
+        elemGuid (elemGuid),
+        bodyCount (bodyCount)
     {
 
     }
 
-    ULong GenerateHashValue () const
-    {
-        return GS::CalculateHashValue (bodyIndex, vertexIndex);
-    }
-
-    bool operator== (const BodyVertex& rhs) const
-    {
-        return bodyIndex == rhs.bodyIndex && vertexIndex == rhs.vertexIndex;
-    }
-
-    Int32 bodyIndex;
-    Int32 vertexIndex;
+    Int32 elementIndex;
+    GS::Guid elemGuid;
+    Int32 bodyCount;
 };
 
-class BodyPolygon
+// An element in the export pipeline. The host stage fills the category, the attributes, the
+// polygons and the materials, a worker the geometry, its serialized shells and the encoded
+// attributes. The ModelerAPI and the IFC API are only called on the calling thread, IFC strings
+// are only copied and released there too, the workers just read them.
+class PipelineElement
 {
 public:
-    BodyPolygon (Int32 bodyIndex, const ModelerAPI::MeshBody& body, const ModelerAPI::Polygon& polygon) :
-        bodyIndex (bodyIndex),
-        body (body),
-        polygon (polygon)
+    PipelineElement () :
+        category (),
+        attributes (),
+        polygons (),
+        materials (),
+        bodyFetchCount (0),
+        geometry (),
+        serializedShells (),
+        encodedAttributes (),
+        encodedAttributeSizes ()
     {
 
     }
 
-    Int32 bodyIndex;
-    ModelerAPI::MeshBody body;
-    ModelerAPI::Polygon polygon;
+    GS::UniString category;
+    std::vector<IfcAttribute> attributes;
+    ElementPolygons polygons;
+    std::vector<Material> materials;
+    UInt64 bodyFetchCount;
+    ElementGeometry geometry;
+    SerializedShells serializedShells;
+    std::vector<char> encodedAttributes;
+    std::vector<size_t> encodedAttributeSizes;
 };
 
-namespace std
+static double SRGBToLinear (double c)
 {
+    return (c < 0.04045) ? c * 0.0773993808 : pow (c * 0.9478672986 + 0.0521327014, 2.4);
+}
+
+static Material CreateMaterial (const ModelerAPI::Model& model, const ModelerAPI::AttributeIndex& materialIndex)
+{
+    ModelerAPI::Material material;
+    model.GetMaterial (materialIndex, &material);
+    ModelerAPI::Color color = material.GetSurfaceColor ();
+    return Material (
+        (uint8_t) (SRGBToLinear (color.red) * 255.0),
+        (uint8_t) (SRGBToLinear (color.green) * 255.0),
+        (uint8_t) (SRGBToLinear (color.blue) * 255.0),
+        (uint8_t) ((1.0 - material.GetTransparency ()) * 255.0),
+        RenderedFaces_TWO,
+        Stroke_DEFAULT
+    );
+}
 
-template <>
-struct hash<ModelerAPI::AttributeIndex>
+class ShellInstance
 {
-    size_t operator() (const ModelerAPI::AttributeIndex& val) const noexcept
+public:
+    ShellInstance (uint32_t representationIndex, flatbuffers::Offset<Shell> fbShell, size_t byteSize) :
+        representationIndex (representationIndex),
+        fbShell (fbShell),
+        byteSize (byteSize)
     {
-        return val.GenerateHashValue ();
+
     }
+
+    uint32_t representationIndex;
+    flatbuffers::Offset<Shell> fbShell;
+    size_t byteSize;
 };
 
-template <>
-struct hash<BodyVertex>
+// Attribute strings are interned, so equal attribute sets have equal string offsets
+class AttributeTable
 {
-    size_t operator() (const BodyVertex& val) const noexcept
+public:
+    AttributeTable (const std::vector<flatbuffers::Offset<flatbuffers::String>>& fbValues, flatbuffers::Offset<Attribute> fbAttribute, size_t byteSize) :
+        fbValues (fbValues),
+        fbAttribute (fbAttribute),
+        byteSize (byteSize)
     {
-        return val.GenerateHashValue ();
+
     }
+
+    std::vector<flatbuffers::Offset<flatbuffers::String>> fbValues;
+    flatbuffers::Offset<Attribute> fbAttribute;
+    size_t byteSize;
 };
 
+static void CombineHash (size_t& hash, size_t value)
+{
+    hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
 }
 
-static double SRGBToLinear (double c)
+static Transform CreateTranslation (const Vector3D& position)
 {
-    return (c < 0.04045) ? c * 0.0773993808 : pow (c * 0.9478672986 + 0.0521327014, 2.4);
+    return Transform (DoubleVector (position.x, position.y, position.z), FloatVector (1.0f, 0.0f, 0.0f), FloatVector (0.0f, 1.0f, 0.0f));
 }
 
-static bool IsEmptyElement (const ModelerAPI::Element& element)
+static Transform CreateTransform (const ShellFrame& frame, const Vector3D& itemCenter)
 {
-    for (Int32 bodyIndex = 1; bodyIndex <= element.GetTessellatedBodyCount (); ++bodyIndex) {
-        ModelerAPI::MeshBody body;
-        element.GetTessellatedBody (bodyIndex, &body);
-        if (body.GetPolygonCount () > 0) {
-            return false;
-        }
-    }
-    return true;
+    return Transform (
+        DoubleVector (frame.origin.x - itemCenter.x, frame.origin.y - itemCenter.y, frame.origin.z - itemCenter.z),
+        FloatVector ((float) frame.xDirection.x, (float) frame.xDirection.y, (float) frame.xDirection.z),
+        FloatVector ((float) frame.yDirection.x, (float) frame.yDirection.y, (float) frame.yDirection.z)
+    );
 }
 
 class MeshListBuilder
 {
 public:
-    MeshListBuilder (flatbuffers::FlatBufferBuilder& fbBuilder, const ModelerAPI::Model& model) :
+    MeshListBuilder (flatbuffers::FlatBufferBuilder& fbBuilder, double coordinateGridSize, ExportStatistics& statistics) :
         fbBuilder (fbBuilder),
-        model (model),
+        coordinateGridSize (coordinateGridSize),
+        statistics (statistics),
         usedMaterials (),
+        shellInstances (),
+        modelMin (MaxDouble, MaxDouble, MaxDouble),
+        modelMax (-MaxDouble, -MaxDouble, -MaxDouble),
+        itemCenters (),
         fbCoordinates (IdentityTransform),
         fbMeshesItems (),
         fbSamples (),
@@ -118,97 +170,211 @@ public:
 
     }
 
-    void AddElement (const ModelerAPI::Element& element)
+    // The materials are the ones the element uses, in the order of materialIndices
+    void AddElement (const ElementGeometry& geometry, const SerializedShells& serializedShells, const std::vector<ModelerAPI::AttributeIndex>& materialIndices, const std::vector<Material>& materials)
     {
         uint32_t meshItemId = (uint32_t) fbMeshesItems.size ();
         fbMeshesItems.push_back (meshItemId);
-        fbGlobalTransforms.push_back (IdentityTransform);
-
-        std::unordered_map<ModelerAPI::AttributeIndex, std::vector<BodyPolygon>> polygonsByMaterial;
-        std::vector<ModelerAPI::AttributeIndex> materials;
-        GetPolygonsByMaterial (element, polygonsByMaterial, materials);
-
-        for (const ModelerAPI::AttributeIndex& materialIndex : materials) {
-            std::vector<flatbuffers::Offset<ShellProfile>> fbProfiles;
-            std::vector<flatbuffers::Offset<ShellHole>> fbHoles;
-            std::vector<FloatVector> fbPoints;
-            std::unordered_map<BodyVertex, uint16_t> bodyVertexIndexToPoint;
-            Vector3D min (MaxDouble, MaxDouble, MaxDouble);
-            Vector3D max (-MaxDouble, -MaxDouble, -MaxDouble);
-            const std::vector<BodyPolygon>& polygons = polygonsByMaterial.at (materialIndex);
-            for (const BodyPolygon& polygon : polygons) {
-                for (Int32 convexPolygonIndex = 1; convexPolygonIndex <= polygon.polygon.GetConvexPolygonCount (); ++convexPolygonIndex) {
-                    ModelerAPI::ConvexPolygon convexPolygon;
-                    polygon.polygon.GetConvexPolygon (convexPolygonIndex, &convexPolygon);
-                    std::vector<uint16_t> fbShellProfileIndices;
-                    for (Int32 vertexIndex = 1; vertexIndex <= convexPolygon.GetVertexCount (); vertexIndex++) {
-                        BodyVertex bodyVertexIndex (polygon.bodyIndex, convexPolygon.GetVertexIndex (vertexIndex));
-                        uint16_t fbVertexIndex = 0;
-                        auto foundVertex = bodyVertexIndexToPoint.find (bodyVertexIndex);
-                        if (foundVertex == bodyVertexIndexToPoint.end ()) {
-                            ModelerAPI::Vertex vertex;
-                            polygon.body.GetVertex (bodyVertexIndex.vertexIndex, &vertex, ModelerAPI::CoordinateSystem::World);
-                            Vector3D rotated = SetUpVectorToY.Apply_V (Vector3D (vertex.x, vertex.y, vertex.z));
-
-                            fbVertexIndex = (uint16_t) fbPoints.size ();
-                            fbPoints.push_back (FloatVector ((float) rotated.x, (float) rotated.y, (float) rotated.z));
-                            bodyVertexIndexToPoint.insert ({ bodyVertexIndex, fbVertexIndex });
-
-                            min.x = GS::Min (min.x, rotated.x);
-                            min.y = GS::Min (min.y, rotated.y);
-                            min.z = GS::Min (min.z, rotated.z);
-                            max.x = GS::Max (max.x, rotated.x);
-                            max.y = GS::Max (max.y, rotated.y);
-                            max.z = GS::Max (max.z, rotated.z);
-                        } else {
-                            fbVertexIndex = foundVertex->second;
-                        }
-                        fbShellProfileIndices.push_back (fbVertexIndex);
-                    }
-                    flatbuffers::Offset<ShellProfile> fbShellProfile = CreateShellProfileDirect (fbBuilder, &fbShellProfileIndices);
-                    fbProfiles.push_back (fbShellProfile);
-                }
-            }
 
-            BoundingBox fbBoundingBox (
-                FloatVector ((float) min.x, (float) min.y, (float) min.z),
-                FloatVector ((float) max.x, (float) max.y, (float) max.z)
-            );
-            Representation fbRepresentation ((uint32_t) fbRepresentations.size (), fbBoundingBox, RepresentationClass_SHELL);
-            uint32_t fbRepresentationIndex = (uint32_t) fbRepresentations.size ();
-            fbRepresentations.push_back (fbRepresentation);
-
-            uint32_t fbMaterialIndex = 0;
-            auto foundMaterial = usedMaterials.find (materialIndex);
-            if (foundMaterial == usedMaterials.end ()) {
-                ModelerAPI::Material material;
-                model.GetMaterial (materialIndex, &material);
-                ModelerAPI::Color color = material.GetSurfaceColor ();
-                Material fbMaterial (
-                    (uint8_t) (SRGBToLinear (color.red) * 255.0),
-                    (uint8_t) (SRGBToLinear (color.green) * 255.0),
-                    (uint8_t) (SRGBToLinear (color.blue) * 255.0),
-                    (uint8_t) ((1.0 - material.GetTransparency ()) * 255.0),
-                    RenderedFaces_TWO,
-                    Stroke_DEFAULT
-                );
-                fbMaterials.push_back (fbMaterial);
-                fbMaterialIndex = (uint32_t) fbMaterials.size () - 1;
-                usedMaterials.insert ({ materialIndex, fbMaterialIndex });
-            } else {
-                fbMaterialIndex = foundMaterial->second;
+        // Items are stored relative to their bounding box center, which is relative to the model origin
+        Vector3D itemCenter = geometry.GetCenter ();
+        itemCenters.push_back (itemCenter);
+        modelMin = Vector3D (GS::Min (modelMin.x, geometry.min.x), GS::Min (modelMin.y, geometry.min.y), GS::Min (modelMin.z, geometry.min.z));
+        modelMax = Vector3D (GS::Max (modelMax.x, geometry.max.x), GS::Max (modelMax.y, geometry.max.y), GS::Max (modelMax.z, geometry.max.z));
+        statistics.weldedPointCount += geometry.weldedPointCount;
+        statistics.decimatedPointCount += geometry.decimatedPointCount;
+        statistics.mergedProfileCount += geometry.mergedProfileCount;
+        statistics.indexDeltaSumBefore += geometry.indexDeltaSumBefore;
+        statistics.indexDeltaSumAfter += geometry.indexDeltaSumAfter;
+
+        for (size_t shellIndex = 0; shellIndex < geometry.shells.size (); ++shellIndex) {
+            const ShellGeometry& shell = geometry.shells[shellIndex];
+            uint32_t fbRepresentationIndex = 0;
+            if (!FindShellInstance (shell, fbRepresentationIndex)) {
+                fbRepresentationIndex = AddShell (shell, itemCenter, serializedShells, shellIndex);
             }
+
+            uint32_t fbMaterialIndex = GetMaterialIndex (shell.materialIndex, materialIndices, materials);
             uint32_t fbLocalTransform = 0;
+            if (shell.hasLocalFrame) {
+                fbLocalTransform = (uint32_t) fbLocalTransforms.size ();
+                fbLocalTransforms.push_back (CreateTransform (shell.localFrame, itemCenter));
+                statistics.instancingSavedBytes -= sizeof (Transform);
+            }
             Sample fbSample (meshItemId, fbMaterialIndex, fbRepresentationIndex, fbLocalTransform);
             fbSamples.push_back (fbSample);
+            statistics.sampleCount += 1;
+        }
+
+        statistics.replacedPointCount += geometry.replacedPointCount;
+        for (const CircleExtrusionGeometry& circleExtrusion : geometry.circleExtrusions) {
+            uint32_t fbRepresentationIndex = AddCircleExtrusion (circleExtrusion, itemCenter);
+            uint32_t fbMaterialIndex = GetMaterialIndex (circleExtrusion.materialIndex, materialIndices, materials);
+            Sample fbSample (meshItemId, fbMaterialIndex, fbRepresentationIndex, 0);
+            fbSamples.push_back (fbSample);
+            statistics.sampleCount += 1;
+            statistics.circleExtrusionCount += 1;
+        }
+    }
+
+    uint32_t GetMaterialIndex (const ModelerAPI::AttributeIndex& materialIndex, const std::vector<ModelerAPI::AttributeIndex>& materialIndices, const std::vector<Material>& materials)
+    {
+        auto foundMaterial = usedMaterials.find (materialIndex);
+        if (foundMaterial != usedMaterials.end ()) {
+            return foundMaterial->second;
+        }
+
+        size_t elementMaterial = std::find (materialIndices.begin (), materialIndices.end (), materialIndex) - materialIndices.begin ();
+        fbMaterials.push_back (materials[elementMaterial]);
+        uint32_t fbMaterialIndex = (uint32_t) fbMaterials.size () - 1;
+        usedMaterials.insert ({ materialIndex, fbMaterialIndex });
+        return fbMaterialIndex;
+    }
+
+    bool FindShellInstance (const ShellGeometry& shell, uint32_t& fbRepresentationIndex)
+    {
+        if (!shell.hasLocalFrame) {
+            return false;
+        }
+
+        auto found = shellInstances.find (shell.instanceHash);
+        if (found == shellInstances.end ()) {
+            return false;
+        }
+
+        for (const ShellInstance& instance : found->second) {
+            const Shell* fbShell = flatbuffers::GetTemporaryPointer (fbBuilder, instance.fbShell);
+            double instanceError = 0.0;
+            if (IsSameShellInstance (shell, *fbShell, coordinateGridSize / 2.0, instanceError)) {
+                // The reused points differ from this shell by more than the snapping
+                statistics.maxCoordinateError = GS::Max (statistics.maxCoordinateError, instanceError);
+                fbRepresentationIndex = instance.representationIndex;
+                statistics.instancedSampleCount += 1;
+                statistics.instancingSavedBytes += instance.byteSize;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    uint32_t AddShell (const ShellGeometry& shell, const Vector3D& itemCenter, const SerializedShells& serializedShells, size_t shellIndex)
+    {
+        Vector3D origin = GetShellOrigin (shell, itemCenter);
+        statistics.pointCount += shell.points.size ();
+        statistics.profileCount += shell.profileSizes.size ();
+        statistics.holeCount += shell.holeSizes.size ();
+        BoundingBox fbBoundingBox (
+            FloatVector (GetStoredCoordinate (shell.min.x - origin.x, coordinateGridSize), GetStoredCoordinate (shell.min.y - origin.y, coordinateGridSize), GetStoredCoordinate (shell.min.z - origin.z, coordinateGridSize)),
+            FloatVector (GetStoredCoordinate (shell.max.x - origin.x, coordinateGridSize), GetStoredCoordinate (shell.max.y - origin.y, coordinateGridSize), GetStoredCoordinate (shell.max.z - origin.z, coordinateGridSize))
+        );
+        Representation fbRepresentation ((uint32_t) fbShells.size (), fbBoundingBox, RepresentationClass_SHELL);
+        uint32_t fbRepresentationIndex = (uint32_t) fbRepresentations.size ();
+        fbRepresentations.push_back (fbRepresentation);
+
+        size_t sizeBefore = fbBuilder.GetSize ();
+        flatbuffers::Offset<Shell> fbShell = serializedShells.Splice (fbBuilder, shellIndex);
+        fbShells.push_back (fbShell);
+
+        if (shell.hasLocalFrame) {
+            size_t byteSize = fbBuilder.GetSize () - sizeBefore;
+            shellInstances[shell.instanceHash].push_back (ShellInstance (fbRepresentationIndex, fbShell, byteSize));
+        }
+
+        return fbRepresentationIndex;
+    }
+
+    uint32_t AddCircleExtrusion (const CircleExtrusionGeometry& circleExtrusion, const Vector3D& origin)
+    {
+        auto toLocal = [&](const Vector3D& point) {
+            return FloatVector ((float) (point.x - origin.x), (float) (point.y - origin.y), (float) (point.z - origin.z));
+        };
+        auto toFloat = [](const Vector3D& direction) {
+            return FloatVector ((float) direction.x, (float) direction.y, (float) direction.z);
+        };
+
+        // The axis vectors are written straight into the builder, so the parts are counted first
+        size_t wireCount = 0;
+        size_t circleCurveCount = 0;
+        for (const AxisPartGeometry& part : circleExtrusion.axisParts) {
+            if (part.type == AxisPartType::Wire) {
+                wireCount += 1;
+            } else {
+                circleCurveCount += 1;
+            }
+        }
+
+        Wire* fbWires = nullptr;
+        flatbuffers::Offset<flatbuffers::Vector<const Wire*>> fbWiresVector = fbBuilder.CreateUninitializedVectorOfStructs (wireCount, &fbWires);
+        size_t wireIndex = 0;
+        for (const AxisPartGeometry& part : circleExtrusion.axisParts) {
+            if (part.type == AxisPartType::Wire) {
+                fbWires[wireIndex++] = Wire (toLocal (part.start), toLocal (part.end));
+            }
+        }
 
-            flatbuffers::Offset<Shell> fbShell = CreateShellDirect (fbBuilder, &fbProfiles, &fbHoles, &fbPoints);
-            fbShells.push_back (fbShell);
+        uint32_t* fbOrder = nullptr;
+        flatbuffers::Offset<flatbuffers::Vector<uint32_t>> fbOrderVector = fbBuilder.CreateUninitializedVector (circleExtrusion.axisParts.size (), &fbOrder);
+        wireIndex = 0;
+        size_t circleCurveIndex = 0;
+        for (size_t partIndex = 0; partIndex < circleExtrusion.axisParts.size (); ++partIndex) {
+            bool isWire = circleExtrusion.axisParts[partIndex].type == AxisPartType::Wire;
+            fbOrder[partIndex] = (uint32_t) (isWire ? wireIndex++ : circleCurveIndex++);
         }
+
+        int8_t* fbParts = nullptr;
+        flatbuffers::Offset<flatbuffers::Vector<int8_t>> fbPartsVector = fbBuilder.CreateUninitializedVector (circleExtrusion.axisParts.size (), &fbParts);
+        for (size_t partIndex = 0; partIndex < circleExtrusion.axisParts.size (); ++partIndex) {
+            fbParts[partIndex] = circleExtrusion.axisParts[partIndex].type == AxisPartType::Wire ? AxisPartClass_WIRE : AxisPartClass_CIRCLE_CURVE;
+        }
+
+        std::vector<flatbuffers::Offset<WireSet>> fbWireSets;
+        flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<WireSet>>> fbWireSetsVector = fbBuilder.CreateVector (fbWireSets);
+
+        CircleCurve* fbCircleCurves = nullptr;
+        flatbuffers::Offset<flatbuffers::Vector<const CircleCurve*>> fbCircleCurvesVector = fbBuilder.CreateUninitializedVectorOfStructs (circleCurveCount, &fbCircleCurves);
+        circleCurveIndex = 0;
+        for (const AxisPartGeometry& part : circleExtrusion.axisParts) {
+            if (part.type == AxisPartType::CircleCurve) {
+                fbCircleCurves[circleCurveIndex++] = CircleCurve ((float) part.aperture, toLocal (part.center), (float) part.radius, toFloat (part.xDirection), toFloat (part.yDirection));
+            }
+        }
+
+        flatbuffers::Offset<Axis> fbAxis = CreateAxis (fbBuilder, fbWiresVector, fbOrderVector, fbPartsVector, fbWireSetsVector, fbCircleCurvesVector);
+        flatbuffers::Offset<flatbuffers::Vector<double>> fbRadiusVector = fbBuilder.CreateVector (&circleExtrusion.radius, 1);
+        flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Axis>>> fbAxesVector = fbBuilder.CreateVector (&fbAxis, 1);
+
+        BoundingBox fbBoundingBox (toLocal (circleExtrusion.min), toLocal (circleExtrusion.max));
+        Representation fbRepresentation ((uint32_t) fbCircleExtrusions.size (), fbBoundingBox, RepresentationClass_CIRCLE_EXTRUSION);
+        uint32_t fbRepresentationIndex = (uint32_t) fbRepresentations.size ();
+        fbRepresentations.push_back (fbRepresentation);
+        fbCircleExtrusions.push_back (CreateCircleExtrusion (fbBuilder, fbRadiusVector, fbAxesVector));
+        return fbRepresentationIndex;
+    }
+
+    // Size of the vectors that are collected per element and only written by CreateMeshes
+    size_t GetPendingSize () const
+    {
+        return fbMeshesItems.size () * sizeof (uint32_t) +
+            fbSamples.size () * sizeof (Sample) +
+            fbRepresentations.size () * sizeof (Representation) +
+            fbMaterials.size () * sizeof (Material) +
+            (fbCircleExtrusions.size () + fbShells.size ()) * sizeof (flatbuffers::uoffset_t) +
+            (fbLocalTransforms.size () + itemCenters.size ()) * sizeof (Transform);
     }
 
     flatbuffers::Offset<Meshes> CreateMeshes ()
     {
+        Vector3D modelOrigin (0.0, 0.0, 0.0);
+        if (modelMin.x <= modelMax.x) {
+            modelOrigin = Vector3D ((modelMin.x + modelMax.x) * 0.5, (modelMin.y + modelMax.y) * 0.5, (modelMin.z + modelMax.z) * 0.5);
+        }
+        fbCoordinates = CreateTranslation (modelOrigin);
+        fbGlobalTransforms.clear ();
+        for (const Vector3D& itemCenter : itemCenters) {
+            fbGlobalTransforms.push_back (CreateTranslation (Vector3D (itemCenter.x - modelOrigin.x, itemCenter.y - modelOrigin.y, itemCenter.z - modelOrigin.z)));
+        }
+
         return CreateMeshesDirect (
             fbBuilder,
             &fbCoordinates,
@@ -223,36 +389,14 @@ public:
         );
     }
 
-    void GetPolygonsByMaterial (
-        const ModelerAPI::Element& element,
-        std::unordered_map<ModelerAPI::AttributeIndex, std::vector<BodyPolygon>>& polygonsByMaterial,
-        std::vector<ModelerAPI::AttributeIndex>& materials)
-    {
-        for (Int32 bodyIndex = 1; bodyIndex <= element.GetTessellatedBodyCount (); ++bodyIndex) {
-            ModelerAPI::MeshBody body;
-            element.GetTessellatedBody (bodyIndex, &body);
-            for (Int32 polygonIndex = 1; polygonIndex <= body.GetPolygonCount (); ++polygonIndex) {
-                ModelerAPI::Polygon polygon;
-                body.GetPolygon (polygonIndex, &polygon);
-                if (polygon.IsInvisible ()) {
-                    continue;
-                }
-                ModelerAPI::AttributeIndex materialIndex;
-                polygon.GetMaterialIndex (materialIndex);
-                auto found = polygonsByMaterial.find (materialIndex);
-                if (found == polygonsByMaterial.end ()) {
-                    polygonsByMaterial.insert ({ materialIndex, { BodyPolygon (bodyIndex, body, polygon) } });
-                    materials.push_back (materialIndex);
-                } else {
-                    found->second.push_back (BodyPolygon (bodyIndex, body, polygon));
-                }
-            }
-        }
-    }
-
     flatbuffers::FlatBufferBuilder& fbBuilder;
-    const ModelerAPI::Model& model;
+    double coordinateGridSize;
+    ExportStatistics& statistics;
     std::unordered_map<ModelerAPI::AttributeIndex, uint32_t> usedMaterials;
+    std::unordered_map<size_t, std::vector<ShellInstance>> shellInstances;
+    Vector3D modelMin;
+    Vector3D modelMax;
+    std::vector<Vector3D> itemCenters;
 
     Transform fbCoordinates;
     std::vector<uint32_t> fbMeshesItems;
@@ -265,25 +409,71 @@ public:
     std::vector<Transform> fbGlobalTransforms;
 };
 
-static bool WriteContentToFile (const IO::Location& location, const std::uint8_t* content, size_t size)
+static std::vector<ExportedElement> CollectExportedElements (const ModelerAPI::Model& model)
 {
-    IO::File file (location, IO::File::OnNotFound::Create);
-    if (file.Open (IO::File::OpenMode::WriteEmptyMode) != NoError) {
-        return false;
+    std::vector<ExportedElement> exportedElements;
+    for (Int32 elementIndex = 1; elementIndex <= model.GetElementCount (); ++elementIndex) {
+        ModelerAPI::Element element;
+        model.GetElement (elementIndex, &element);
+        if (element.IsInvalid ()) {
+            continue;
+        }
+        exportedElements.push_back (ExportedElement (elementIndex, element.GetElemGuid (), element.GetTessellatedBodyCount ()));
     }
+    return exportedElements;
+}
 
-    if (file.WriteBin ((char*) content, (GS::USize) size) != NoError) {
-        return false;
+// The elements with the most tessellated bodies, the count is known without fetching any body
+static std::vector<size_t> GetExpensiveElements (const std::vector<ExportedElement>& exportedElements, size_t maxCount)
+{
+    std::vector<size_t> elementIndices (exportedElements.size ());
+    for (size_t exportedElementIndex = 0; exportedElementIndex < exportedElements.size (); ++exportedElementIndex) {
+        elementIndices[exportedElementIndex] = exportedElementIndex;
     }
+    size_t count = GS::Min (maxCount, elementIndices.size ());
+    std::partial_sort (elementIndices.begin (), elementIndices.begin () + count, elementIndices.end (), [&](size_t a, size_t b) {
+        if (exportedElements[a].bodyCount != exportedElements[b].bodyCount) {
+            return exportedElements[a].bodyCount > exportedElements[b].bodyCount;
+        }
+        return a < b;
+    });
+    elementIndices.resize (count);
+    return elementIndices;
+}
+
+static bool WriteContentToFile (const IO::Location& location, const std::uint8_t* content, size_t size)
+{
+    TemporaryFile file;
+    return file.Open (location) && file.Write (content, size) && file.Commit ();
+}
 
-    file.Close ();
-    return true;
+// Stores every distinct string once, a string already in the buffer costs only its offset
+static flatbuffers::Offset<flatbuffers::String> InternString (flatbuffers::FlatBufferBuilder& builder, const char* str, size_t length, UInt64& sharedCount, UInt64& savedBytes)
+{
+    size_t sizeBefore = builder.GetSize ();
+    flatbuffers::Offset<flatbuffers::String> fbString = builder.CreateSharedString (str, length);
+    if (builder.GetSize () == sizeBefore) {
+        size_t paddedLength = (length + 1 + sizeof (flatbuffers::uoffset_t) - 1) & ~(sizeof (flatbuffers::uoffset_t) - 1);
+        sharedCount += 1;
+        savedBytes += sizeof (flatbuffers::uoffset_t) + paddedLength;
+    }
+    return fbString;
 }
 
-bool ExportFragmentsFile (const ModelerAPI::Model& model, const IO::Location& location, const FragmentsExportSettings& settings)
+static bool ExportFragments (const ModelerAPI::Model& model, const IO::Location& location, const FragmentsExportSettings& settings, IfcPropertySource& propertySource, ExportStatistics& statistics)
 {
-    flatbuffers::FlatBufferBuilder builder;
-    MeshListBuilder meshListBuilder (builder, model);
+    IfcPropertyCache propertyCache (propertySource);
+    std::vector<ExportedElement> exportedElements = CollectExportedElements (model);
+
+    // In raw mode the buffer is built right in the output file, if the file can be mapped
+    HeapBufferAllocator heapAllocator;
+    MappedFileAllocator mappedFileAllocator;
+    bool mappedOutput = settings.compressionMode == CompressionMode::Raw && mappedFileAllocator.Open (location);
+    BufferAllocator* bufferAllocator = mappedOutput ? static_cast<BufferAllocator*> (&mappedFileAllocator) : &heapAllocator;
+    ModelBufferBuilder builder (exportedElements.size (), bufferAllocator);
+    double coordinateGridSize = GetCoordinateGridSize (settings.coordinatePrecision);
+    MeshListBuilder meshListBuilder (builder, coordinateGridSize, statistics);
+    statistics.coordinateGridSize = coordinateGridSize;
 
     GS::Guid projectGuid (GS::Guid::GenerateGuid);
     const char* fbMetaData = "{}";
@@ -293,38 +483,151 @@ bool ExportFragmentsFile (const ModelerAPI::Model& model, const IO::Location& lo
     std::vector<flatbuffers::Offset<Attribute>> fbAttributes;
 
     std::vector<flatbuffers::Offset<flatbuffers::String>> fbCategories;
+    std::unordered_map<size_t, std::vector<AttributeTable>> attributeTables;
+    std::vector<flatbuffers::Offset<flatbuffers::String>> attributeValues;
+
+    // The ModelerAPI and IFC lookups stay on the calling thread, the geometry and the attribute
+    // encoding run on the workers, and the builder is filled in element order, so the output is
+    // identical for any thread count
+    ExportPipeline pipeline (GetExportThreadCount (settings.threadCount));
+    std::vector<PipelineElement> pipelineElements (pipeline.GetSlotCount ());
+    ElementPolygonReader polygonReader;
+    std::unordered_map<ModelerAPI::AttributeIndex, Material> fetchedMaterials;
+    std::vector<ElementGeometryExtractor> extractors;
+    std::vector<AttributeJsonEncoder> attributeEncoders (pipeline.GetWorkerCount ());
+    std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> shellBuilders;
+    extractors.reserve (pipeline.GetWorkerCount ());
+    for (UInt32 workerIndex = 0; workerIndex < pipeline.GetWorkerCount (); ++workerIndex) {
+        extractors.emplace_back (settings);
+        shellBuilders.push_back (AcquireShellBuilder ());
+    }
 
-    uint32_t elementLocalId = 1;
-    for (Int32 elementIndex = 1; elementIndex <= model.GetElementCount (); ++elementIndex) {
+    auto hostStage = [&](size_t exportedElementIndex, UInt32 slotIndex) {
+        const GS::Guid& elemGuid = exportedElements[exportedElementIndex].elemGuid;
+        PipelineElement& pipelineElement = pipelineElements[slotIndex];
         ModelerAPI::Element element;
-        model.GetElement (elementIndex, &element);
-        if (element.IsInvalid () || IsEmptyElement (element)) {
-            continue;
+        model.GetElement (exportedElements[exportedElementIndex].elementIndex, &element);
+        polygonReader.Read (element, pipelineElement.polygons);
+        pipelineElement.bodyFetchCount = pipelineElement.polygons.bodyPositions.size ();
+        pipelineElement.materials.clear ();
+        for (const ModelerAPI::AttributeIndex& materialIndex : pipelineElement.polygons.materials) {
+            auto found = fetchedMaterials.find (materialIndex);
+            if (found == fetchedMaterials.end ()) {
+                found = fetchedMaterials.insert ({ materialIndex, CreateMaterial (model, materialIndex) }).first;
+            }
+            pipelineElement.materials.push_back (found->second);
+        }
+
+        // Elements without visible polygons are skipped, the IFC lookups would be wasted on them
+        pipelineElement.category.Clear ();
+        pipelineElement.attributes.clear ();
+        if (pipelineElement.polygons.visiblePolygonCount == 0) {
+            return;
+        }
+        pipelineElement.category = propertyCache.GetIfcType (elemGuid);
+        propertyCache.EnumerateIfcAttributes (elemGuid, [&](const GS::UniString& name, const GS::UniString& value, const GS::UniString& type) {
+            pipelineElement.attributes.emplace_back (name, value, type);
+        });
+    };
+
+    auto workerStage = [&](size_t exportedElementIndex, UInt32 slotIndex, UInt32 workerIndex) {
+        PipelineElement& pipelineElement = pipelineElements[slotIndex];
+        pipelineElement.geometry = ElementGeometry ();
+        extractors[workerIndex].Extract (pipelineElement.polygons, settings.GetDecimationSettings (pipelineElement.category), pipelineElement.geometry);
+
+        // Shells are serialized even if they turn out to be instances, that is only known in element order
+        Vector3D itemCenter = pipelineElement.geometry.GetCenter ();
+        pipelineElement.serializedShells.Clear ();
+        for (const ShellGeometry& shell : pipelineElement.geometry.shells) {
+            pipelineElement.serializedShells.Add (*shellBuilders[workerIndex], shell, itemCenter, coordinateGridSize);
+        }
+
+        AttributeJsonEncoder& attributeEncoder = attributeEncoders[workerIndex];
+        pipelineElement.encodedAttributes.clear ();
+        pipelineElement.encodedAttributeSizes.clear ();
+        for (const IfcAttribute& attribute : pipelineElement.attributes) {
+            attributeEncoder.Encode (attribute.name, attribute.value, attribute.type);
+            pipelineElement.encodedAttributes.insert (pipelineElement.encodedAttributes.end (), attributeEncoder.GetData (), attributeEncoder.GetData () + attributeEncoder.GetSize ());
+            pipelineElement.encodedAttributeSizes.push_back (attributeEncoder.GetSize ());
+        }
+    };
+
+    uint32_t elementLocalId = 1;
+    auto finalStage = [&](size_t exportedElementIndex, UInt32 slotIndex) {
+        PipelineElement& pipelineElement = pipelineElements[slotIndex];
+        const ElementGeometry& elementGeometry = pipelineElement.geometry;
+        statistics.bodyFetchCount += pipelineElement.bodyFetchCount;
+
+        size_t pendingSize = meshListBuilder.GetPendingSize () + (fbGuids.size () + fbGuidsItems.size () + fbLocalIds.size () + fbCategories.size () + fbAttributes.size ()) * sizeof (uint32_t);
+        builder.ReserveForElements (exportedElementIndex, pendingSize);
+
+        // Elements without visible geometry are not exported at all
+        if (elementGeometry.shells.empty () && elementGeometry.circleExtrusions.empty ()) {
+            statistics.skippedElementCount += 1;
+            return;
         }
 
-        GS::Guid elemGuid = element.GetElemGuid ();
+        const GS::Guid& elemGuid = exportedElements[exportedElementIndex].elemGuid;
         fbGuids.push_back (builder.CreateString (elemGuid.ToString ().ToCStr ()));
         fbGuidsItems.push_back (elementLocalId);
         fbLocalIds.push_back (elementLocalId);
-        meshListBuilder.AddElement (element);
-
-        GS::UniString ifcType = GetIfcType (elemGuid);
-        fbCategories.push_back (builder.CreateString (ifcType.ToCStr (CC_UTF8).Get ()));
-
-        std::vector<flatbuffers::Offset<flatbuffers::String>> attributeValues;
-        EnumerateIfcAttributes (elemGuid, [&](const GS::UniString& name, const GS::UniString& value, const GS::UniString& type) {
-            GS::UniString attributeJson = GS::UniString::Printf ("[\"%T\",\"%T\",\"%T\"]",
-                name.ToPrintf (),
-                value.ToPrintf (),
-                type.ToPrintf ()
-                );
-            attributeValues.push_back (builder.CreateString (attributeJson.ToCStr (CC_UTF8).Get ()));
+        meshListBuilder.AddElement (elementGeometry, pipelineElement.serializedShells, pipelineElement.polygons.materials, pipelineElement.materials);
+        statistics.maxCoordinateError = GS::Max (statistics.maxCoordinateError, pipelineElement.serializedShells.GetMaxCoordinateError ());
+
+        auto category = pipelineElement.category.ToCStr (CC_UTF8);
+        fbCategories.push_back (InternString (builder, category.Get (), strlen (category.Get ()), statistics.sharedCategoryCount, statistics.sharedCategoryBytes));
+
+        attributeValues.clear ();
+        size_t attributeHash = 0;
+        const char* encodedAttribute = pipelineElement.encodedAttributes.data ();
+        for (size_t encodedAttributeSize : pipelineElement.encodedAttributeSizes) {
+            flatbuffers::Offset<flatbuffers::String> fbValue = InternString (builder, encodedAttribute, encodedAttributeSize, statistics.sharedAttributeCount, statistics.sharedAttributeBytes);
+            attributeValues.push_back (fbValue);
+            CombineHash (attributeHash, fbValue.o);
+            encodedAttribute += encodedAttributeSize;
+        }
+
+        std::vector<AttributeTable>& sameHashTables = attributeTables[attributeHash];
+        auto foundTable = std::find_if (sameHashTables.begin (), sameHashTables.end (), [&](const AttributeTable& table) {
+            return std::equal (table.fbValues.begin (), table.fbValues.end (), attributeValues.begin (), attributeValues.end (),
+                [](flatbuffers::Offset<flatbuffers::String> a, flatbuffers::Offset<flatbuffers::String> b) {
+                    return a.o == b.o;
+                });
         });
-        flatbuffers::Offset<Attribute> attribute = CreateAttributeDirect (builder, &attributeValues);
-        fbAttributes.push_back (attribute);
+        if (foundTable != sameHashTables.end ()) {
+            fbAttributes.push_back (foundTable->fbAttribute);
+            statistics.sharedAttributeTableCount += 1;
+            statistics.sharedAttributeTableBytes += foundTable->byteSize;
+        } else {
+            size_t sizeBefore = builder.GetSize ();
+            flatbuffers::Offset<Attribute> attribute = CreateAttributeDirect (builder, &attributeValues);
+            sameHashTables.push_back (AttributeTable (attributeValues, attribute, builder.GetSize () - sizeBefore));
+            fbAttributes.push_back (attribute);
+        }
 
         elementLocalId += 1;
+    };
+
+    // The most expensive elements start first, so no worker is left with one at the end
+    PipelineStatistics pipelineStatistics;
+    std::vector<size_t> expensiveElements = GetExpensiveElements (exportedElements, pipeline.GetWorkerCount ());
+    pipeline.Run (exportedElements.size (), expensiveElements, hostStage, workerStage, finalStage, pipelineStatistics);
+    for (std::unique_ptr<flatbuffers::FlatBufferBuilder>& shellBuilder : shellBuilders) {
+        ReleaseShellBuilder (std::move (shellBuilder));
     }
+    statistics.pipelineWorkerCount = pipeline.GetWorkerCount ();
+    statistics.pipelineSlotCount = pipeline.GetSlotCount ();
+    statistics.pipelineOccupancySum = pipelineStatistics.occupancySum;
+    statistics.pipelineOccupancySampleCount = pipelineStatistics.occupancySampleCount;
+    statistics.hostStageBusyTime = pipelineStatistics.hostBusyTime;
+    statistics.hostStageStallTime = pipelineStatistics.hostStallTime;
+    statistics.workerStageBusyTime = pipelineStatistics.workerBusyTime;
+    statistics.workerStageStallTime = pipelineStatistics.workerStallTime;
+    statistics.finalStageBusyTime = pipelineStatistics.finalBusyTime;
+    statistics.finalStageStallTime = pipelineStatistics.finalStallTime;
+
+    statistics.propertyCacheHitCount = propertyCache.GetHitCount ();
+    statistics.propertyCacheMissCount = propertyCache.GetMissCount ();
 
     uint32_t fbMaxLocalId = elementLocalId;
     flatbuffers::Offset<Meshes> fbMeshes = meshListBuilder.CreateMeshes ();
@@ -348,20 +651,40 @@ bool ExportFragmentsFile (const ModelerAPI::Model& model, const IO::Location& lo
 
     // Do not use FinishModelBuffer to avoid writing identifier
     builder.Finish (fbModel);
+    builder.FinishEstimate ();
 
     bool successfulWrite = false;
-    if (settings.compressionMode == CompressionMode::Raw) {
+    statistics.bufferSize = builder.GetSize ();
+    statistics.bufferReallocationCount = bufferAllocator->GetReallocationCount ();
+    statistics.bufferPeakSize = bufferAllocator->GetPeakSize ();
+    if (mappedOutput) {
+        successfulWrite = mappedFileAllocator.Commit (builder.GetBufferPointer (), builder.GetSize ());
+        statistics.outputSize = builder.GetSize ();
+    } else if (settings.compressionMode == CompressionMode::Raw) {
         successfulWrite = WriteContentToFile (location, builder.GetBufferPointer (), builder.GetSize ());
+        statistics.outputSize = builder.GetSize ();
     } else if (settings.compressionMode == CompressionMode::Compressed) {
-        mz_ulong compressedBound = mz_compressBound (builder.GetSize ());
-        std::uint8_t* compressedBuffer = new std::uint8_t[compressedBound];
-        mz_ulong compressedLength = compressedBound;
-        int compressStatus = mz_compress (compressedBuffer, &compressedLength, builder.GetBufferPointer (), builder.GetSize ());
-        if (compressStatus == MZ_OK) {
-            successfulWrite = WriteContentToFile (location, compressedBuffer, compressedLength);
+        UInt32 threadCount = GetExportThreadCount (settings.threadCount);
+        CompressionSettings compression = settings.compression;
+        if (settings.compressionTimeBudget > 0.0) {
+            compression = ChooseCompressionSettings (builder.GetBufferPointer (), builder.GetSize (), threadCount, settings.compressionTimeBudget, statistics.compressionTrialTime);
         }
-        delete[] compressedBuffer;
+        statistics.compressionLevel = compression.level;
+        statistics.compressionStrategy = (UInt64) compression.strategy;
+        successfulWrite = WriteCompressedFile (location, builder.GetBufferPointer (), builder.GetSize (), compression, threadCount, statistics.outputSize, statistics.compressedBlockCount);
     }
 
     return successfulWrite;
 }
+
+bool ExportFragmentsFile (const ModelerAPI::Model& model, const IO::Location& location, const FragmentsExportSettings& settings, IfcPropertySource& propertySource, ExportStatistics& statistics)
+{
+    // A full disk under the mapped buffer is a bad_alloc, and the pipeline rethrows the exceptions
+    // of its stages. They fail the export instead of leaving the add-on, the unwinding deletes the
+    // temporary file.
+    try {
+        return ExportFragments (model, location, settings, propertySource, statistics);
+    } catch (...) {
+        return false;
+    }
+}
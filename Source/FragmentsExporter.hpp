@@ -1,8 +1,10 @@
 #pragma once
 
 #include "FragmentsSettings.hpp"
+#include "ExportStatistics.hpp"
+#include "IfcPropertySource.hpp"
 
 #include <Model.hpp>
 #include <Location.hpp>
 
-bool ExportFragmentsFile (const ModelerAPI::Model& apiModel, const IO::Location& location, const FragmentsExportSettings& settings);
+bool ExportFragmentsFile (const ModelerAPI::Model& apiModel, const IO::Location& location, const FragmentsExportSettings& settings, IfcPropertySource& propertySource, ExportStatistics& statistics);
@@ -7,6 +7,7 @@
 
 #include "DebugUtils.hpp"
 #include "FragmentsExporter.hpp"
+#include "PropertyUtils.hpp"
 #include "ResourceIds.hpp"
 
 static const GSType FileTypeId = 1;
@@ -48,9 +49,14 @@ static GSErrCode ExportFragmentsFromSaveAs (const API_IOParams* ioParams, Modele
 
     FragmentsExportSettings settings;
     settings.compressionMode = CompressionMode::Compressed;
-    if (!ExportFragmentsFile (model, *ioParams->fileLoc, settings)) {
+    ArchicadIfcPropertySource propertySource;
+    ExportStatistics statistics;
+    if (!ExportFragmentsFile (model, *ioParams->fileLoc, settings, propertySource, statistics)) {
         return APIERR_GENERAL;
     }
+#ifdef DEBUG
+    WriteExportStatistics (statistics);
+#endif
 
     return NoError;
 }
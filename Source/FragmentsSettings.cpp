@@ -1,10 +1,68 @@
 #include "FragmentsSettings.hpp"
 
-GS::ClassInfo FragmentsExportSettings::classInfo ("FragmentsExportSettings", GS::Guid ("5E707044-9008-49A4-90CD-0BE9B6F52AE5"), GS::ClassVersion (1, 0));
+GS::ClassInfo FragmentsExportSettings::classInfo ("FragmentsExportSettings", GS::Guid ("5E707044-9008-49A4-90CD-0BE9B6F52AE5"), GS::ClassVersion (1, 9));
+
+CompressionSettings::CompressionSettings () :
+    level (-1),
+    strategy (CompressionStrategy::Default)
+{
+
+}
+
+CompressionSettings::CompressionSettings (Int32 level, CompressionStrategy strategy) :
+    level (level),
+    strategy (strategy)
+{
+
+}
+
+DecimationSettings::DecimationSettings () :
+    maxError (0.0),
+    keepRatio (1.0)
+{
+
+}
+
+DecimationSettings::DecimationSettings (double maxError, double keepRatio) :
+    maxError (maxError),
+    keepRatio (keepRatio)
+{
+
+}
+
+bool DecimationSettings::IsEnabled () const
+{
+    return maxError > 0.0 || keepRatio < 1.0;
+}
+
+CategoryDecimationSettings::CategoryDecimationSettings () :
+    category (),
+    decimation ()
+{
+
+}
+
+CategoryDecimationSettings::CategoryDecimationSettings (const GS::UniString& category, const DecimationSettings& decimation) :
+    category (category),
+    decimation (decimation)
+{
+
+}
 
 FragmentsExportSettings::FragmentsExportSettings () :
     GS::Object (),
-    compressionMode (CompressionMode::Raw)
+    compressionMode (CompressionMode::Raw),
+    compression (),
+    compressionTimeBudget (0.0),
+    threadCount (0),
+    geometryInstancing (true),
+    weldTolerance (0.0),
+    reconstructPolygons (true),
+    circleExtrusionTolerance (0.0),
+    reorderShells (true),
+    coordinatePrecision (0.0),
+    decimation (),
+    categoryDecimations ()
 {
 
 }
@@ -13,6 +71,46 @@ GSErrCode FragmentsExportSettings::Read (GS::IChannel& ic)
 {
     GS::InputFrame frame (ic, classInfo);
     ic.ReadEnum<Int32, CompressionMode> (compressionMode);
+    if (frame.GetMinorVersion () >= 1) {
+        ic.Read (threadCount);
+    }
+    if (frame.GetMinorVersion () >= 2) {
+        ic.Read (geometryInstancing);
+    }
+    if (frame.GetMinorVersion () >= 3) {
+        ic.Read (weldTolerance);
+    }
+    if (frame.GetMinorVersion () >= 4) {
+        ic.Read (reconstructPolygons);
+    }
+    if (frame.GetMinorVersion () >= 5) {
+        ic.Read (circleExtrusionTolerance);
+    }
+    if (frame.GetMinorVersion () >= 6) {
+        ic.Read (decimation.maxError);
+        ic.Read (decimation.keepRatio);
+        Int32 categoryCount = 0;
+        ic.Read (categoryCount);
+        categoryDecimations.clear ();
+        for (Int32 i = 0; i < categoryCount; ++i) {
+            CategoryDecimationSettings categoryDecimation;
+            categoryDecimation.category.Read (ic);
+            ic.Read (categoryDecimation.decimation.maxError);
+            ic.Read (categoryDecimation.decimation.keepRatio);
+            categoryDecimations.push_back (categoryDecimation);
+        }
+    }
+    if (frame.GetMinorVersion () >= 7) {
+        ic.Read (compression.level);
+        ic.ReadEnum<Int32, CompressionStrategy> (compression.strategy);
+        ic.Read (compressionTimeBudget);
+    }
+    if (frame.GetMinorVersion () >= 8) {
+        ic.Read (coordinatePrecision);
+    }
+    if (frame.GetMinorVersion () >= 9) {
+        ic.Read (reorderShells);
+    }
     return ic.GetInputStatus ();
 }
 
@@ -20,5 +118,33 @@ GSErrCode FragmentsExportSettings::Write (GS::OChannel& oc) const
 {
     GS::OutputFrame frame (oc, classInfo);
     oc.WriteEnum<Int32, CompressionMode> (compressionMode);
+    oc.Write (threadCount);
+    oc.Write (geometryInstancing);
+    oc.Write (weldTolerance);
+    oc.Write (reconstructPolygons);
+    oc.Write (circleExtrusionTolerance);
+    oc.Write (decimation.maxError);
+    oc.Write (decimation.keepRatio);
+    oc.Write ((Int32) categoryDecimations.size ());
+    for (const CategoryDecimationSettings& categoryDecimation : categoryDecimations) {
+        categoryDecimation.category.Write (oc);
+        oc.Write (categoryDecimation.decimation.maxError);
+        oc.Write (categoryDecimation.decimation.keepRatio);
+    }
+    oc.Write (compression.level);
+    oc.WriteEnum<Int32, CompressionStrategy> (compression.strategy);
+    oc.Write (compressionTimeBudget);
+    oc.Write (coordinatePrecision);
+    oc.Write (reorderShells);
     return oc.GetOutputStatus ();
 }
+
+const DecimationSettings& FragmentsExportSettings::GetDecimationSettings (const GS::UniString& category) const
+{
+    for (const CategoryDecimationSettings& categoryDecimation : categoryDecimations) {
+        if (categoryDecimation.category.IsEqual (category, GS::UniString::CaseInsensitive)) {
+            return categoryDecimation.decimation;
+        }
+    }
+    return decimation;
+}
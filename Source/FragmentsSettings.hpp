@@ -1,6 +1,9 @@
 #pragma once
 
 #include <Object.hpp>
+#include <UniString.hpp>
+
+#include <vector>
 
 enum class CompressionMode : Int32
 {
@@ -8,6 +11,47 @@ enum class CompressionMode : Int32
     Compressed = 1,
 };
 
+enum class CompressionStrategy : Int32
+{
+    Default = 0,
+    Filtered = 1, // prefers literals to short matches, for data with small value changes
+    RunLength = 2, // only repeats of the previous byte, fast but weaker
+};
+
+// Deflate parameters of the compressed export.
+class CompressionSettings
+{
+public:
+    CompressionSettings ();
+    CompressionSettings (Int32 level, CompressionStrategy strategy);
+
+    Int32 level; // 0 stores the data, 1 is the fastest, 9 the smallest zlib level, 10 is even slower, -1 is the default
+    CompressionStrategy strategy;
+};
+
+// Simplification stops at whichever limit is reached first.
+class DecimationSettings
+{
+public:
+    DecimationSettings ();
+    DecimationSettings (double maxError, double keepRatio);
+
+    bool IsEnabled () const;
+
+    double maxError; // max distance of the simplified surface from the original in meters, 0 means no limit
+    double keepRatio; // fraction of triangles to keep, 1 means no limit
+};
+
+class CategoryDecimationSettings
+{
+public:
+    CategoryDecimationSettings ();
+    CategoryDecimationSettings (const GS::UniString& category, const DecimationSettings& decimation);
+
+    GS::UniString category; // IFC type of the elements, like IfcFurnishingElement
+    DecimationSettings decimation;
+};
+
 class FragmentsExportSettings : public GS::Object
 {
     DECLARE_CLASS_INFO;
@@ -18,5 +62,18 @@ public:
     virtual GSErrCode Read (GS::IChannel& ic) override;
     virtual GSErrCode Write (GS::OChannel& oc) const override;
 
+    const DecimationSettings& GetDecimationSettings (const GS::UniString& category) const;
+
     CompressionMode compressionMode;
+    CompressionSettings compression;
+    double compressionTimeBudget; // seconds, chooses the compression settings from trials on samples of the buffer, 0 uses the settings above
+    Int32 threadCount; // 0 means one thread per hardware core, 1 disables parallel processing
+    bool geometryInstancing; // store repeated geometry once and reference it with transforms
+    double weldTolerance; // merge shell points closer than this distance in meters, 0 disables welding
+    bool reconstructPolygons; // merge coplanar convex pieces into polygons with holes
+    double circleExtrusionTolerance; // max distance of tube points from the recognized circle extrusion in meters, 0 (default) exports tubes as shells
+    bool reorderShells; // sort the points and the profiles of the shells by location, for better compression and vertex reuse
+    double coordinatePrecision; // grid step of the shell points in meters, rounded down to a power of two, points move at most half a step, 0 keeps full float precision
+    DecimationSettings decimation; // disabled by default
+    std::vector<CategoryDecimationSettings> categoryDecimations; // overrides decimation for the listed categories
 };
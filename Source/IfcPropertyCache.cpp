@@ -0,0 +1,100 @@
+#include "IfcPropertyCache.hpp"
+
+static const GS::UniString IfcBuildingElementProxy = "IFCBUILDINGELEMENTPROXY";
+
+IfcPropertySource::~IfcPropertySource ()
+{
+
+}
+
+IfcPropertyCache::IfcPropertyCache (IfcPropertySource& source) :
+    source (source),
+    parentGuids (),
+    parentTypes (),
+    parentAttributes (),
+    hitCount (0),
+    missCount (0)
+{
+
+}
+
+GS::UniString IfcPropertyCache::GetIfcType (const GS::Guid& elemGuid)
+{
+    GS::UniString ifcType;
+    IfcLookupResult result = source.GetIfcType (elemGuid, ifcType);
+    if (result == IfcLookupResult::Found) {
+        return ifcType;
+    }
+    if (result == IfcLookupResult::Failed) {
+        return IfcBuildingElementProxy;
+    }
+
+    GS::Optional<GS::Guid> parentGuid = GetParentElemGuid (elemGuid);
+    if (!parentGuid.HasValue ()) {
+        return IfcBuildingElementProxy;
+    }
+
+    auto found = parentTypes.find (parentGuid.Get ());
+    if (found != parentTypes.end ()) {
+        hitCount += 1;
+        return found->second;
+    }
+    missCount += 1;
+    ifcType = GetIfcType (parentGuid.Get ());
+    parentTypes.insert ({ parentGuid.Get (), ifcType });
+    return ifcType;
+}
+
+void IfcPropertyCache::EnumerateIfcAttributes (const GS::Guid& elemGuid, const IfcAttributeEnumerator& enumerator)
+{
+    if (source.EnumerateIfcAttributes (elemGuid, enumerator) != IfcLookupResult::NoOwnData) {
+        return;
+    }
+
+    GS::Optional<GS::Guid> parentGuid = GetParentElemGuid (elemGuid);
+    if (!parentGuid.HasValue ()) {
+        return;
+    }
+
+    for (const IfcAttribute& attribute : GetParentAttributes (parentGuid.Get ())) {
+        enumerator (attribute.name, attribute.value, attribute.type);
+    }
+}
+
+UInt64 IfcPropertyCache::GetHitCount () const
+{
+    return hitCount;
+}
+
+UInt64 IfcPropertyCache::GetMissCount () const
+{
+    return missCount;
+}
+
+GS::Optional<GS::Guid> IfcPropertyCache::GetParentElemGuid (const GS::Guid& elemGuid)
+{
+    auto found = parentGuids.find (elemGuid);
+    if (found != parentGuids.end ()) {
+        hitCount += 1;
+        return found->second;
+    }
+    missCount += 1;
+    GS::Optional<GS::Guid> parentGuid = source.GetParentElemGuid (elemGuid);
+    parentGuids.insert ({ elemGuid, parentGuid });
+    return parentGuid;
+}
+
+const std::vector<IfcAttribute>& IfcPropertyCache::GetParentAttributes (const GS::Guid& parentGuid)
+{
+    auto found = parentAttributes.find (parentGuid);
+    if (found != parentAttributes.end ()) {
+        hitCount += 1;
+        return found->second;
+    }
+    missCount += 1;
+    std::vector<IfcAttribute> attributes;
+    EnumerateIfcAttributes (parentGuid, [&](const GS::UniString& name, const GS::UniString& value, const GS::UniString& type) {
+        attributes.push_back (IfcAttribute (name, value, type));
+    });
+    return parentAttributes.insert ({ parentGuid, std::move (attributes) }).first->second;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "IfcPropertySource.hpp"
+
+class IfcAttribute
+{
+public:
+    IfcAttribute (const GS::UniString& name, const GS::UniString& value, const GS::UniString& type) :
+        name (name),
+        value (value),
+        type (type)
+    {
+
+    }
+
+    GS::UniString name;
+    GS::UniString value;
+    GS::UniString type;
+};
+
+namespace std
+{
+
+template <>
+struct hash<GS::Guid>
+{
+    size_t operator() (const GS::Guid& val) const noexcept
+    {
+        return val.GenerateHashValue ();
+    }
+};
+
+}
+
+// Elements without IFC data of their own use the data of their parent, like the panels of
+// a curtain wall. Elements that can't be resolved are proxies without attributes. The
+// parents and their results are memoized, so siblings resolve them once.
+class IfcPropertyCache
+{
+public:
+    IfcPropertyCache (IfcPropertySource& source);
+
+    GS::UniString GetIfcType (const GS::Guid& elemGuid);
+    void EnumerateIfcAttributes (const GS::Guid& elemGuid, const IfcAttributeEnumerator& enumerator);
+
+    UInt64 GetHitCount () const;
+    UInt64 GetMissCount () const;
+
+private:
+    GS::Optional<GS::Guid> GetParentElemGuid (const GS::Guid& elemGuid);
+    const std::vector<IfcAttribute>& GetParentAttributes (const GS::Guid& parentGuid);
+
+    IfcPropertySource& source;
+    std::unordered_map<GS::Guid, GS::Optional<GS::Guid>> parentGuids;
+    std::unordered_map<GS::Guid, GS::UniString> parentTypes;
+    std::unordered_map<GS::Guid, std::vector<IfcAttribute>> parentAttributes;
+    UInt64 hitCount;
+    UInt64 missCount;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <GSGuid.hpp>
+#include <Optional.hpp>
+#include <UniString.hpp>
+
+#include <functional>
+
+using IfcAttributeEnumerator = std::function<void (const GS::UniString&, const GS::UniString&, const GS::UniString&)>;
+
+enum class IfcLookupResult
+{
+    Found,
+    NoOwnData, // the element has an IFC object, but its data comes from the parent element
+    Failed // the element or its IFC object can't be resolved, it has no IFC data at all
+};
+
+// IFC data of the elements, without any fallback logic. The exporter reads it through
+// IfcPropertyCache. The interface only uses GSRoot types, so an implementation that
+// doesn't call the Archicad API can link without a running Archicad.
+class IfcPropertySource
+{
+public:
+    virtual ~IfcPropertySource ();
+
+    virtual IfcLookupResult GetIfcType (const GS::Guid& elemGuid, GS::UniString& ifcType) = 0;
+    virtual IfcLookupResult EnumerateIfcAttributes (const GS::Guid& elemGuid, const IfcAttributeEnumerator& enumerator) = 0;
+
+    virtual GS::Optional<GS::Guid> GetParentElemGuid (const GS::Guid& elemGuid) = 0;
+};
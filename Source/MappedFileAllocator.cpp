@@ -0,0 +1,139 @@
+#include "MappedFileAllocator.hpp"
+
+#include <cstring>
+#include <new>
+
+#if defined (WINDOWS)
+#include <Win32Interface.hpp>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+MappedFileAllocator::MappedFileAllocator () :
+    BufferAllocator (),
+    file (),
+#if defined (WINDOWS)
+    mappingHandle (nullptr),
+#endif
+    mapping (nullptr),
+    mappingSize (0)
+{
+
+}
+
+MappedFileAllocator::~MappedFileAllocator ()
+{
+    Unmap ();
+}
+
+bool MappedFileAllocator::Open (const IO::Location& location)
+{
+    return file.Open (location);
+}
+
+bool MappedFileAllocator::Commit (const uint8_t* data, size_t size)
+{
+    if (mapping == nullptr || data < mapping || data + size > mapping + mappingSize) {
+        return false;
+    }
+
+    memmove (mapping, data, size);
+    Unmap ();
+    return file.Resize (size) && file.Commit ();
+}
+
+uint8_t* MappedFileAllocator::allocate (size_t size)
+{
+    // The builder holds a single buffer, the file has room for only one
+    if (mapping != nullptr || !Extend (0, size) || !Map (size)) {
+        throw std::bad_alloc ();
+    }
+    AddAllocatedSize (size);
+    return mapping;
+}
+
+void MappedFileAllocator::deallocate (uint8_t* p, size_t size)
+{
+    // After a commit the buffer is already unmapped
+    if (p != mapping) {
+        return;
+    }
+    Unmap ();
+    RemoveAllocatedSize (size);
+}
+
+uint8_t* MappedFileAllocator::reallocate_downward (uint8_t* oldP, size_t oldSize, size_t newSize, size_t inUseBack, size_t /*inUseFront*/)
+{
+    // The data stays in the file while it is remapped, the front part keeps its place,
+    // only the back part has to move to the new end
+    reallocationCount += 1;
+    if (oldP != mapping) {
+        throw std::bad_alloc ();
+    }
+    Unmap ();
+    RemoveAllocatedSize (oldSize);
+    if (!Extend (oldSize, newSize) || !Map (newSize)) {
+        throw std::bad_alloc ();
+    }
+    AddAllocatedSize (newSize);
+    memmove (mapping + newSize - inUseBack, mapping + oldSize - inUseBack, inUseBack);
+    return mapping;
+}
+
+bool MappedFileAllocator::Map (size_t size)
+{
+#if defined (WINDOWS)
+    ULARGE_INTEGER mappingLength;
+    mappingLength.QuadPart = size;
+    mappingHandle = CreateFileMappingW (file.GetHandle (), nullptr, PAGE_READWRITE, mappingLength.HighPart, mappingLength.LowPart, nullptr);
+    if (mappingHandle == nullptr) {
+        return false;
+    }
+    void* view = MapViewOfFile (mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (view == nullptr) {
+        CloseHandle (mappingHandle);
+        mappingHandle = nullptr;
+        return false;
+    }
+#else
+    void* view = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.GetDescriptor (), 0);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+#endif
+    mapping = static_cast<uint8_t*> (view);
+    mappingSize = size;
+    return true;
+}
+
+void MappedFileAllocator::Unmap ()
+{
+    if (mapping == nullptr) {
+        return;
+    }
+#if defined (WINDOWS)
+    UnmapViewOfFile (mapping);
+    CloseHandle (mappingHandle);
+    mappingHandle = nullptr;
+#else
+    munmap (mapping, mappingSize);
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+bool MappedFileAllocator::Extend (size_t oldSize, size_t newSize)
+{
+    // The new part of the file gets its disk blocks here, a sparse file would only fail at the
+    // first write through the mapping when the disk is full, and that is a crash, not an error
+#if defined (WINDOWS)
+    // The file is not sparse, so setting its end allocates the clusters without writing them
+    return file.Resize (newSize);
+#elif defined (__APPLE__)
+    fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t) (newSize - oldSize), 0 };
+    return fcntl (file.GetDescriptor (), F_PREALLOCATE, &store) != -1 && file.Resize (newSize);
+#else
+    return posix_fallocate (file.GetDescriptor (), (off_t) oldSize, (off_t) (newSize - oldSize)) == 0;
+#endif
+}
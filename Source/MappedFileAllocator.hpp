@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Location.hpp>
+
+#include "ModelBufferBuilder.hpp"
+#include "TemporaryFile.hpp"
+
+// Keeps the model buffer in a memory-mapped temporary file next to the destination, so the buffer
+// can be larger than the available memory and does not have to be written out at the end. The
+// mapping grows by remapping the extended file, the disk space is reserved before that, so a full
+// disk is a bad_alloc. The builder fills the buffer back to front, so committing moves the used
+// part to the start of the file, truncates the file and renames it over the destination.
+class MappedFileAllocator : public BufferAllocator
+{
+public:
+    MappedFileAllocator ();
+    virtual ~MappedFileAllocator ();
+
+    bool Open (const IO::Location& location);
+    bool Commit (const uint8_t* data, size_t size);
+
+    virtual uint8_t* allocate (size_t size) override;
+    virtual void deallocate (uint8_t* p, size_t size) override;
+    virtual uint8_t* reallocate_downward (uint8_t* oldP, size_t oldSize, size_t newSize, size_t inUseBack, size_t inUseFront) override;
+
+private:
+    bool Map (size_t size);
+    void Unmap ();
+    bool Extend (size_t oldSize, size_t newSize);
+
+    TemporaryFile file;
+#if defined (WINDOWS)
+    void* mappingHandle;
+#endif
+    uint8_t* mapping;
+    size_t mappingSize;
+};
@@ -0,0 +1,402 @@
+#include "MeshDecimation.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+static const double MinNormalDot = 0.2;
+static const double ErrorQuantum = 1.0e-12;
+
+class Quadric
+{
+public:
+    Quadric () :
+        values ()
+    {
+
+    }
+
+    void AddPlane (const Vector3D& normal, double offset)
+    {
+        double plane[4] = { normal.x, normal.y, normal.z, offset };
+        int index = 0;
+        for (int i = 0; i < 4; ++i) {
+            for (int j = i; j < 4; ++j) {
+                values[index++] += plane[i] * plane[j];
+            }
+        }
+    }
+
+    void Add (const Quadric& other)
+    {
+        for (int i = 0; i < 10; ++i) {
+            values[i] += other.values[i];
+        }
+    }
+
+    // Sum of squared distances from the accumulated planes
+    double GetError (const Vector3D& p) const
+    {
+        const double* q = values;
+        return q[0] * p.x * p.x + 2.0 * q[1] * p.x * p.y + 2.0 * q[2] * p.x * p.z + 2.0 * q[3] * p.x +
+            q[4] * p.y * p.y + 2.0 * q[5] * p.y * p.z + 2.0 * q[6] * p.y +
+            q[7] * p.z * p.z + 2.0 * q[8] * p.z +
+            q[9];
+    }
+
+    double values[10];
+};
+
+class EdgeCollapse
+{
+public:
+    EdgeCollapse (double error, UInt32 from, UInt32 to, UInt32 fromVersion, UInt32 toVersion, const Vector3D& position) :
+        error (error),
+        from (from),
+        to (to),
+        fromVersion (fromVersion),
+        toVersion (toVersion),
+        position (position)
+    {
+
+    }
+
+    // Smallest error first, ties are broken by the indices, so copies of the same shell collapse the same way
+    bool operator< (const EdgeCollapse& other) const
+    {
+        if (error != other.error) {
+            return error > other.error;
+        }
+        if (to != other.to) {
+            return to > other.to;
+        }
+        return from > other.from;
+    }
+
+    double error;
+    UInt32 from;
+    UInt32 to;
+    UInt32 fromVersion;
+    UInt32 toVersion;
+    Vector3D position;
+};
+
+class DecimationMesh
+{
+public:
+    DecimationMesh () :
+        points (),
+        triangles (),
+        aliveTriangles (),
+        pointTriangles (),
+        quadrics (),
+        locked (),
+        removed (),
+        versions (),
+        origin (0.0, 0.0, 0.0)
+    {
+
+    }
+
+    std::vector<Vector3D> points;
+    std::vector<UInt32> triangles;
+    std::vector<bool> aliveTriangles;
+    std::vector<std::vector<UInt32>> pointTriangles;
+    std::vector<Quadric> quadrics;
+    std::vector<bool> locked;
+    std::vector<bool> removed;
+    std::vector<UInt32> versions;
+    Vector3D origin;
+};
+
+static double Dot (const Vector3D& a, const Vector3D& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3D Cross (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static Vector3D Subtract (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static Vector3D GetTriangleNormal (const Vector3D& a, const Vector3D& b, const Vector3D& c)
+{
+    return Cross (Subtract (b, a), Subtract (c, a));
+}
+
+static UInt64 GetEdgeKey (UInt32 a, UInt32 b)
+{
+    return a < b ? ((UInt64) a << 32) | b : ((UInt64) b << 32) | a;
+}
+
+static bool TriangleHasPoint (const DecimationMesh& mesh, UInt32 triangle, UInt32 point)
+{
+    const UInt32* indices = &mesh.triangles[triangle * 3];
+    return indices[0] == point || indices[1] == point || indices[2] == point;
+}
+
+static void CollectNeighbours (const DecimationMesh& mesh, UInt32 point, std::vector<UInt32>& neighbours)
+{
+    neighbours.clear ();
+    for (UInt32 triangle : mesh.pointTriangles[point]) {
+        for (int i = 0; i < 3; ++i) {
+            UInt32 other = mesh.triangles[triangle * 3 + i];
+            if (other != point && std::find (neighbours.begin (), neighbours.end (), other) == neighbours.end ()) {
+                neighbours.push_back (other);
+            }
+        }
+    }
+}
+
+// Moving the point must not flip or collapse any of its triangles that survive the collapse
+static bool KeepsOrientation (const DecimationMesh& mesh, UInt32 point, UInt32 otherPoint, const Vector3D& position)
+{
+    for (UInt32 triangle : mesh.pointTriangles[point]) {
+        if (TriangleHasPoint (mesh, triangle, otherPoint)) {
+            continue;
+        }
+        const UInt32* indices = &mesh.triangles[triangle * 3];
+        Vector3D corners[3] = { mesh.points[indices[0]], mesh.points[indices[1]], mesh.points[indices[2]] };
+        Vector3D oldNormal = GetTriangleNormal (corners[0], corners[1], corners[2]);
+        for (int i = 0; i < 3; ++i) {
+            if (indices[i] == point) {
+                corners[i] = position;
+            }
+        }
+        Vector3D newNormal = GetTriangleNormal (corners[0], corners[1], corners[2]);
+        double oldLength = sqrt (Dot (oldNormal, oldNormal));
+        double newLength = sqrt (Dot (newNormal, newNormal));
+        if (newLength <= 0.0 || Dot (oldNormal, newNormal) < MinNormalDot * oldLength * newLength) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collapsing an edge is only valid if the endpoints share no neighbours besides the
+// opposite corners of the edge triangles, otherwise the surface would pinch
+static bool IsCollapsible (const DecimationMesh& mesh, UInt32 from, UInt32 to, std::vector<UInt32>& fromNeighbours, std::vector<UInt32>& toNeighbours)
+{
+    size_t edgeTriangleCount = 0;
+    for (UInt32 triangle : mesh.pointTriangles[from]) {
+        if (TriangleHasPoint (mesh, triangle, to)) {
+            edgeTriangleCount += 1;
+        }
+    }
+    CollectNeighbours (mesh, from, fromNeighbours);
+    CollectNeighbours (mesh, to, toNeighbours);
+    size_t sharedCount = 0;
+    for (UInt32 neighbour : fromNeighbours) {
+        if (std::find (toNeighbours.begin (), toNeighbours.end (), neighbour) != toNeighbours.end ()) {
+            sharedCount += 1;
+        }
+    }
+    return edgeTriangleCount > 0 && sharedCount == edgeTriangleCount;
+}
+
+static bool GetCollapse (const DecimationMesh& mesh, UInt32 from, UInt32 to, EdgeCollapse& collapse)
+{
+    if (mesh.locked[from] && mesh.locked[to]) {
+        return false;
+    }
+    if (mesh.locked[from]) {
+        std::swap (from, to);
+    }
+
+    Quadric quadric = mesh.quadrics[from];
+    quadric.Add (mesh.quadrics[to]);
+
+    // Locked points stay in place, otherwise take the best of the endpoints and the midpoint
+    const Vector3D& fromPoint = mesh.points[from];
+    const Vector3D& toPoint = mesh.points[to];
+    Vector3D position = toPoint;
+    double error = quadric.GetError (toPoint);
+    if (!mesh.locked[to]) {
+        Vector3D midPoint ((fromPoint.x + toPoint.x) * 0.5, (fromPoint.y + toPoint.y) * 0.5, (fromPoint.z + toPoint.z) * 0.5);
+        for (const Vector3D& candidate : { fromPoint, midPoint }) {
+            double candidateError = quadric.GetError (candidate);
+            if (candidateError < error) {
+                error = candidateError;
+                position = candidate;
+            }
+        }
+    }
+
+    collapse = EdgeCollapse (floor (GS::Max (error, 0.0) / ErrorQuantum) * ErrorQuantum, from, to, mesh.versions[from], mesh.versions[to], position);
+    return true;
+}
+
+static void BuildDecimationMesh (const ShellGeometry& shell, DecimationMesh& mesh)
+{
+    // Quadrics are evaluated relative to the shell center to avoid cancellation at large coordinates
+    mesh.origin = Vector3D ((shell.min.x + shell.max.x) * 0.5, (shell.min.y + shell.max.y) * 0.5, (shell.min.z + shell.max.z) * 0.5);
+    mesh.points.reserve (shell.points.size ());
+    for (const Vector3D& point : shell.points) {
+        mesh.points.push_back (Subtract (point, mesh.origin));
+    }
+    size_t profileStart = 0;
+    for (uint32_t profileSize : shell.profileSizes) {
+        for (uint32_t i = 1; i + 1 < profileSize; ++i) {
+            mesh.triangles.push_back (shell.profileIndices[profileStart]);
+            mesh.triangles.push_back (shell.profileIndices[profileStart + i]);
+            mesh.triangles.push_back (shell.profileIndices[profileStart + i + 1]);
+        }
+        profileStart += profileSize;
+    }
+
+    UInt32 triangleCount = (UInt32) (mesh.triangles.size () / 3);
+    mesh.aliveTriangles.assign (triangleCount, true);
+    mesh.pointTriangles.resize (mesh.points.size ());
+    mesh.quadrics.resize (mesh.points.size ());
+    mesh.locked.assign (mesh.points.size (), false);
+    mesh.removed.assign (mesh.points.size (), false);
+    mesh.versions.assign (mesh.points.size (), 0);
+
+    std::unordered_map<UInt64, UInt32> edgeCounts;
+    for (UInt32 triangle = 0; triangle < triangleCount; ++triangle) {
+        const UInt32* indices = &mesh.triangles[triangle * 3];
+        Vector3D normal = GetTriangleNormal (mesh.points[indices[0]], mesh.points[indices[1]], mesh.points[indices[2]]);
+        double length = sqrt (Dot (normal, normal));
+        for (int i = 0; i < 3; ++i) {
+            mesh.pointTriangles[indices[i]].push_back (triangle);
+            edgeCounts[GetEdgeKey (indices[i], indices[(i + 1) % 3])] += 1;
+        }
+        if (length <= 0.0) {
+            continue;
+        }
+        normal = Vector3D (normal.x / length, normal.y / length, normal.z / length);
+        for (int i = 0; i < 3; ++i) {
+            mesh.quadrics[indices[i]].AddPlane (normal, -Dot (normal, mesh.points[indices[0]]));
+        }
+    }
+
+    // Open and non-manifold edges are material seams or modeling details, keep them
+    for (const auto& edgeCount : edgeCounts) {
+        if (edgeCount.second != 2) {
+            mesh.locked[(UInt32) (edgeCount.first >> 32)] = true;
+            mesh.locked[(UInt32) (edgeCount.first & 0xFFFFFFFF)] = true;
+        }
+    }
+}
+
+static void CollapseEdge (DecimationMesh& mesh, const EdgeCollapse& collapse, UInt32& aliveTriangleCount)
+{
+    UInt32 from = collapse.from;
+    UInt32 to = collapse.to;
+    for (UInt32 triangle : mesh.pointTriangles[from]) {
+        if (TriangleHasPoint (mesh, triangle, to)) {
+            mesh.aliveTriangles[triangle] = false;
+            aliveTriangleCount -= 1;
+            continue;
+        }
+        UInt32* indices = &mesh.triangles[triangle * 3];
+        for (int i = 0; i < 3; ++i) {
+            if (indices[i] == from) {
+                indices[i] = to;
+            }
+        }
+        mesh.pointTriangles[to].push_back (triangle);
+    }
+    mesh.pointTriangles[from].clear ();
+
+    std::vector<UInt32>& toTriangles = mesh.pointTriangles[to];
+    toTriangles.erase (std::remove_if (toTriangles.begin (), toTriangles.end (), [&](UInt32 triangle) {
+        return !mesh.aliveTriangles[triangle];
+    }), toTriangles.end ());
+
+    mesh.points[to] = collapse.position;
+    mesh.quadrics[to].Add (mesh.quadrics[from]);
+    mesh.removed[from] = true;
+    mesh.versions[from] += 1;
+    mesh.versions[to] += 1;
+}
+
+size_t DecimateShell (ShellGeometry& shell, const DecimationSettings& decimation)
+{
+    if (!decimation.IsEnabled () || shell.profileSizes.empty () || !shell.holeSizes.empty ()) {
+        return 0;
+    }
+
+    DecimationMesh mesh;
+    BuildDecimationMesh (shell, mesh);
+    UInt32 triangleCount = (UInt32) mesh.aliveTriangles.size ();
+    UInt32 aliveTriangleCount = triangleCount;
+    UInt32 targetTriangleCount = decimation.keepRatio < 1.0 ? (UInt32) ceil (triangleCount * GS::Max (decimation.keepRatio, 0.0)) : 0;
+    double maxError = decimation.maxError > 0.0 ? decimation.maxError * decimation.maxError : MaxDouble;
+
+    // Every undirected edge is queued once, whatever the winding of the triangles using it
+    std::priority_queue<EdgeCollapse> collapses;
+    std::unordered_set<UInt64> queuedEdges;
+    queuedEdges.reserve (mesh.triangles.size ());
+    for (UInt32 triangle = 0; triangle < triangleCount; ++triangle) {
+        for (int i = 0; i < 3; ++i) {
+            UInt32 a = mesh.triangles[triangle * 3 + i];
+            UInt32 b = mesh.triangles[triangle * 3 + (i + 1) % 3];
+            EdgeCollapse collapse (0.0, 0, 0, 0, 0, Vector3D (0.0, 0.0, 0.0));
+            if (queuedEdges.insert (GetEdgeKey (a, b)).second && GetCollapse (mesh, GS::Min (a, b), GS::Max (a, b), collapse)) {
+                collapses.push (collapse);
+            }
+        }
+    }
+
+    std::vector<UInt32> fromNeighbours;
+    std::vector<UInt32> toNeighbours;
+    bool anyCollapsed = false;
+    while (!collapses.empty () && aliveTriangleCount > targetTriangleCount) {
+        EdgeCollapse collapse = collapses.top ();
+        collapses.pop ();
+        if (collapse.error > maxError) {
+            break;
+        }
+        if (mesh.removed[collapse.from] || mesh.removed[collapse.to] ||
+            collapse.fromVersion != mesh.versions[collapse.from] || collapse.toVersion != mesh.versions[collapse.to])
+        {
+            continue;
+        }
+        if (!IsCollapsible (mesh, collapse.from, collapse.to, fromNeighbours, toNeighbours) ||
+            !KeepsOrientation (mesh, collapse.from, collapse.to, collapse.position) ||
+            !KeepsOrientation (mesh, collapse.to, collapse.from, collapse.position))
+        {
+            continue;
+        }
+
+        CollapseEdge (mesh, collapse, aliveTriangleCount);
+        anyCollapsed = true;
+
+        CollectNeighbours (mesh, collapse.to, toNeighbours);
+        for (UInt32 neighbour : toNeighbours) {
+            EdgeCollapse newCollapse = collapse;
+            if (GetCollapse (mesh, neighbour, collapse.to, newCollapse)) {
+                collapses.push (newCollapse);
+            }
+        }
+    }
+    if (!anyCollapsed) {
+        return 0;
+    }
+
+    size_t pointCount = shell.points.size ();
+    for (size_t pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+        const Vector3D& point = mesh.points[pointIndex];
+        shell.points[pointIndex] = Vector3D (point.x + mesh.origin.x, point.y + mesh.origin.y, point.z + mesh.origin.z);
+    }
+    shell.profileIndices.clear ();
+    shell.profileSizes.clear ();
+    for (UInt32 triangle = 0; triangle < triangleCount; ++triangle) {
+        if (!mesh.aliveTriangles[triangle]) {
+            continue;
+        }
+        for (int i = 0; i < 3; ++i) {
+            shell.profileIndices.push_back ((uint16_t) mesh.triangles[triangle * 3 + i]);
+        }
+        shell.profileSizes.push_back (3);
+    }
+    shell.RemoveUnusedPoints ();
+    return pointCount - shell.points.size ();
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+#include "FragmentsSettings.hpp"
+
+// Quadric error metric edge collapse on the triangulated profiles of the shell. Points on
+// open edges are kept in place, so seams between shells of different materials stay closed.
+// Returns the number of removed points.
+size_t DecimateShell (ShellGeometry& shell, const DecimationSettings& decimation);
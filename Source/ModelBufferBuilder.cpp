@@ -0,0 +1,120 @@
+#include "ModelBufferBuilder.hpp"
+
+// Without a previous export the estimate starts low, the extrapolation takes over soon
+static const size_t DefaultBytesPerElement = 256;
+
+// The first elements are not representative, so they are not extrapolated
+static const size_t MinExtrapolatedElementCount = 32;
+
+static size_t lastBytesPerElement = 0;
+
+static size_t GetInitialSize (size_t elementCount)
+{
+    size_t bytesPerElement = lastBytesPerElement > 0 ? lastBytesPerElement : DefaultBytesPerElement;
+    return GS::Max (elementCount * bytesPerElement, (size_t) 1024);
+}
+
+BufferAllocator::BufferAllocator () :
+    reallocationCount (0),
+    allocatedSize (0),
+    peakSize (0)
+{
+
+}
+
+BufferAllocator::~BufferAllocator ()
+{
+
+}
+
+UInt64 BufferAllocator::GetReallocationCount () const
+{
+    return reallocationCount;
+}
+
+size_t BufferAllocator::GetPeakSize () const
+{
+    return peakSize;
+}
+
+void BufferAllocator::AddAllocatedSize (size_t size)
+{
+    allocatedSize += size;
+    peakSize = GS::Max (peakSize, allocatedSize);
+}
+
+void BufferAllocator::RemoveAllocatedSize (size_t size)
+{
+    allocatedSize -= size;
+}
+
+HeapBufferAllocator::HeapBufferAllocator () :
+    BufferAllocator ()
+{
+
+}
+
+uint8_t* HeapBufferAllocator::allocate (size_t size)
+{
+    uint8_t* p = new uint8_t[size];
+    AddAllocatedSize (size);
+    return p;
+}
+
+void HeapBufferAllocator::deallocate (uint8_t* p, size_t size)
+{
+    delete[] p;
+    RemoveAllocatedSize (size);
+}
+
+uint8_t* HeapBufferAllocator::reallocate_downward (uint8_t* oldP, size_t oldSize, size_t newSize, size_t inUseBack, size_t inUseFront)
+{
+    reallocationCount += 1;
+    return flatbuffers::Allocator::reallocate_downward (oldP, oldSize, newSize, inUseBack, inUseFront);
+}
+
+ModelBufferBuilder::ModelBufferBuilder (size_t elementCount, flatbuffers::Allocator* allocator) :
+    flatbuffers::FlatBufferBuilder (GetInitialSize (elementCount), allocator),
+    elementCount (elementCount)
+{
+
+}
+
+void ModelBufferBuilder::ReserveForElements (size_t writtenElementCount, size_t pendingSize)
+{
+    if (writtenElementCount < MinExtrapolatedElementCount || writtenElementCount >= elementCount) {
+        return;
+    }
+
+    // The later the estimate, the more elements it is based on, so it waits until the buffer is almost full
+    if (buf_.unused_buffer_size () > GetCapacity () / 8) {
+        return;
+    }
+
+    size_t writtenSize = GetSize () + pendingSize;
+    size_t projectedSize = (size_t) ((double) writtenSize * (double) elementCount / (double) writtenElementCount);
+    if (projectedSize <= GetCapacity ()) {
+        return;
+    }
+
+    // The buffer grows by the requested length, but at least by half of its capacity, so an estimate
+    // below that is left to the regular growth. Above it the new capacity is exactly the target size.
+    size_t targetSize = projectedSize + projectedSize / 8;
+    size_t growthSize = targetSize - GetCapacity ();
+    if (growthSize <= GetCapacity () / 2) {
+        return;
+    }
+    buf_.ensure_space (growthSize);
+}
+
+void ModelBufferBuilder::FinishEstimate ()
+{
+    if (elementCount > 0) {
+        lastBytesPerElement = GS::Max (GetSize () / elementCount, (size_t) 1);
+    }
+}
+
+size_t ModelBufferBuilder::GetCapacity () const
+{
+    return buf_.capacity ();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Definitions.hpp>
+
+#include "Schema/index_generated.h"
+
+// Allocator of the model buffer that counts the reallocations and the peak memory held.
+class BufferAllocator : public flatbuffers::Allocator
+{
+public:
+    BufferAllocator ();
+    virtual ~BufferAllocator ();
+
+    UInt64 GetReallocationCount () const;
+    size_t GetPeakSize () const;
+
+protected:
+    void AddAllocatedSize (size_t size);
+    void RemoveAllocatedSize (size_t size);
+
+    UInt64 reallocationCount;
+    size_t allocatedSize;
+    size_t peakSize;
+};
+
+// Heap allocator of the model buffer. During a reallocation both the old and the new buffer
+// are alive, that is where the peak comes from.
+class HeapBufferAllocator : public BufferAllocator
+{
+public:
+    HeapBufferAllocator ();
+
+    virtual uint8_t* allocate (size_t size) override;
+    virtual void deallocate (uint8_t* p, size_t size) override;
+    virtual uint8_t* reallocate_downward (uint8_t* oldP, size_t oldSize, size_t newSize, size_t inUseBack, size_t inUseFront) override;
+};
+
+// Builder of the model buffer. The initial size comes from the bytes per element of the previous
+// export, and the final size is extrapolated from the elements written so far, so the buffer grows
+// in a few large steps instead of many 1.5x steps that copy the whole buffer each time.
+class ModelBufferBuilder : public flatbuffers::FlatBufferBuilder
+{
+public:
+    ModelBufferBuilder (size_t elementCount, flatbuffers::Allocator* allocator);
+
+    // pendingSize is the size of the data that is collected now but written at the end
+    void ReserveForElements (size_t writtenElementCount, size_t pendingSize);
+    void FinishEstimate ();
+
+    size_t GetCapacity () const;
+
+private:
+    size_t elementCount;
+};
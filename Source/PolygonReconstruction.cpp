@@ -0,0 +1,463 @@
+#include "PolygonReconstruction.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+static const double NormalTolerance = 1.0e-6;
+static const double PlaneTolerance = 1.0e-4;
+static const double CollinearTolerance = 1.0e-9;
+static const UInt32 NoProfile = (UInt32) -1;
+
+class ProfilePlane
+{
+public:
+    ProfilePlane () :
+        normal (0.0, 0.0, 0.0),
+        offset (0.0),
+        valid (false)
+    {
+
+    }
+
+    Vector3D normal;
+    double offset;
+    bool valid;
+};
+
+class MergedFace
+{
+public:
+    std::vector<uint16_t> outerIndices;
+    std::vector<std::vector<uint16_t>> holes;
+};
+
+class ShellFaces
+{
+public:
+    std::vector<size_t> profileStarts;
+    std::vector<std::vector<UInt32>> groups;
+    std::vector<MergedFace> faces;
+    std::vector<bool> mergedGroups;
+    std::vector<bool> keptPoints;
+};
+
+class ShellPoint
+{
+public:
+    ShellPoint (const Vector3D& position, UInt32 shellIndex, UInt32 pointIndex) :
+        position (position),
+        shellIndex (shellIndex),
+        pointIndex (pointIndex)
+    {
+
+    }
+
+    bool operator< (const ShellPoint& rhs) const
+    {
+        if (position.x != rhs.position.x) {
+            return position.x < rhs.position.x;
+        }
+        if (position.y != rhs.position.y) {
+            return position.y < rhs.position.y;
+        }
+        return position.z < rhs.position.z;
+    }
+
+    Vector3D position;
+    UInt32 shellIndex;
+    UInt32 pointIndex;
+};
+
+static UInt32 GetEdgeKey (uint16_t from, uint16_t to)
+{
+    return ((UInt32) from << 16) | (UInt32) to;
+}
+
+static double Dot (const Vector3D& a, const Vector3D& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3D GetLoopNormal (const std::vector<Vector3D>& points, const uint16_t* indices, size_t count)
+{
+    Vector3D normal (0.0, 0.0, 0.0);
+    for (size_t i = 0; i < count; ++i) {
+        const Vector3D& current = points[indices[i]];
+        const Vector3D& next = points[indices[(i + 1) % count]];
+        normal.x += (current.y - next.y) * (current.z + next.z);
+        normal.y += (current.z - next.z) * (current.x + next.x);
+        normal.z += (current.x - next.x) * (current.y + next.y);
+    }
+    return normal;
+}
+
+static ProfilePlane GetProfilePlane (const std::vector<Vector3D>& points, const uint16_t* indices, size_t count)
+{
+    ProfilePlane plane;
+    Vector3D normal = GetLoopNormal (points, indices, count);
+    double length = sqrt (Dot (normal, normal));
+    if (length <= 0.0) {
+        return plane;
+    }
+    plane.normal = Vector3D (normal.x / length, normal.y / length, normal.z / length);
+    plane.offset = Dot (plane.normal, points[indices[0]]);
+    plane.valid = true;
+    return plane;
+}
+
+static bool IsSamePlane (const ProfilePlane& a, const ProfilePlane& b)
+{
+    return a.valid && b.valid && Dot (a.normal, b.normal) >= 1.0 - NormalTolerance && fabs (a.offset - b.offset) <= PlaneTolerance;
+}
+
+static UInt32 FindRoot (std::vector<UInt32>& parents, UInt32 profileIndex)
+{
+    while (parents[profileIndex] != profileIndex) {
+        parents[profileIndex] = parents[parents[profileIndex]];
+        profileIndex = parents[profileIndex];
+    }
+    return profileIndex;
+}
+
+// Marks the points of the loop that are corners, the others lie on a straight edge of it
+static void KeepCornerPoints (const std::vector<Vector3D>& points, const std::vector<uint16_t>& loop, std::vector<bool>& keptPoints)
+{
+    for (size_t i = 0; i < loop.size (); ++i) {
+        const Vector3D& prev = points[loop[(i + loop.size () - 1) % loop.size ()]];
+        const Vector3D& current = points[loop[i]];
+        const Vector3D& next = points[loop[(i + 1) % loop.size ()]];
+        Vector3D a (current.x - prev.x, current.y - prev.y, current.z - prev.z);
+        Vector3D b (next.x - current.x, next.y - current.y, next.z - current.z);
+        Vector3D cross (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+        if (Dot (a, b) <= 0.0 || Dot (cross, cross) > CollinearTolerance * Dot (a, a) * Dot (b, b)) {
+            keptPoints[loop[i]] = true;
+        }
+    }
+}
+
+// A loop that would lose its area keeps all of its points
+static bool KeepDegenerateLoop (const std::vector<uint16_t>& loop, std::vector<bool>& keptPoints)
+{
+    size_t keptCount = 0;
+    for (uint16_t pointIndex : loop) {
+        keptCount += keptPoints[pointIndex] ? 1 : 0;
+    }
+    if (keptCount >= 3 || keptCount == loop.size ()) {
+        return false;
+    }
+    for (uint16_t pointIndex : loop) {
+        keptPoints[pointIndex] = true;
+    }
+    return true;
+}
+
+static void RemoveCollinearPoints (const std::vector<bool>& keptPoints, std::vector<uint16_t>& loop)
+{
+    loop.erase (std::remove_if (loop.begin (), loop.end (), [&](uint16_t pointIndex) {
+        return !keptPoints[pointIndex];
+    }), loop.end ());
+}
+
+// Boundary edges of the group are the edges without a reversed pair inside the group.
+// Faces with non-manifold edges or touching boundary loops are left as they are.
+static bool MergeProfiles (
+    const ShellGeometry& shell,
+    const std::vector<size_t>& profileStarts,
+    const std::vector<UInt32>& groupProfiles,
+    const ProfilePlane& plane,
+    MergedFace& face)
+{
+    std::unordered_map<UInt32, UInt32> edgeCounts;
+    for (UInt32 profileIndex : groupProfiles) {
+        const uint16_t* indices = &shell.profileIndices[profileStarts[profileIndex]];
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            UInt32& count = edgeCounts[GetEdgeKey (indices[i], indices[(i + 1) % profileSize])];
+            count += 1;
+            if (count > 1) {
+                return false;
+            }
+        }
+    }
+
+    std::vector<UInt32> boundaryEdges;
+    std::unordered_map<uint16_t, uint16_t> nextPoints;
+    for (UInt32 profileIndex : groupProfiles) {
+        const uint16_t* indices = &shell.profileIndices[profileStarts[profileIndex]];
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            uint16_t from = indices[i];
+            uint16_t to = indices[(i + 1) % profileSize];
+            if (edgeCounts.find (GetEdgeKey (to, from)) != edgeCounts.end ()) {
+                continue;
+            }
+            if (!nextPoints.insert ({ from, to }).second) {
+                return false;
+            }
+            boundaryEdges.push_back (GetEdgeKey (from, to));
+        }
+    }
+
+    std::vector<std::vector<uint16_t>> loops;
+    size_t usedEdgeCount = 0;
+    for (UInt32 edgeKey : boundaryEdges) {
+        uint16_t start = (uint16_t) (edgeKey >> 16);
+        auto found = nextPoints.find (start);
+        if (found == nextPoints.end ()) {
+            continue;
+        }
+        std::vector<uint16_t> loop;
+        uint16_t current = start;
+        while (found != nextPoints.end ()) {
+            loop.push_back (current);
+            current = found->second;
+            nextPoints.erase (found);
+            found = nextPoints.find (current);
+        }
+        if (current != start || loop.size () < 3) {
+            return false;
+        }
+        usedEdgeCount += loop.size ();
+        loops.push_back (std::move (loop));
+    }
+    if (usedEdgeCount != boundaryEdges.size ()) {
+        return false;
+    }
+
+    int outerLoopIndex = -1;
+    for (size_t loopIndex = 0; loopIndex < loops.size (); ++loopIndex) {
+        const std::vector<uint16_t>& loop = loops[loopIndex];
+        if (Dot (GetLoopNormal (shell.points, loop.data (), loop.size ()), plane.normal) > 0.0) {
+            if (outerLoopIndex != -1) {
+                return false;
+            }
+            outerLoopIndex = (int) loopIndex;
+        }
+    }
+    if (outerLoopIndex == -1) {
+        return false;
+    }
+
+    face.outerIndices = loops[outerLoopIndex];
+    for (size_t loopIndex = 0; loopIndex < loops.size (); ++loopIndex) {
+        if ((int) loopIndex != outerLoopIndex) {
+            face.holes.push_back (loops[loopIndex]);
+        }
+    }
+    return true;
+}
+
+// Groups the coplanar connected profiles of the shell and merges each group into a face.
+// Returns false if no profiles were joined, the shell is left as it is then.
+static bool MergeShellFaces (const ShellGeometry& shell, ShellFaces& shellFaces)
+{
+    UInt32 profileCount = (UInt32) shell.profileSizes.size ();
+    if (profileCount < 2 || !shell.holeSizes.empty ()) {
+        return false;
+    }
+
+    std::vector<size_t>& profileStarts = shellFaces.profileStarts;
+    profileStarts.assign (profileCount, 0);
+    std::vector<ProfilePlane> planes (profileCount);
+    std::unordered_map<UInt32, UInt32> edgeProfiles;
+    size_t profileStart = 0;
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        const uint16_t* indices = &shell.profileIndices[profileStart];
+        profileStarts[profileIndex] = profileStart;
+        planes[profileIndex] = GetProfilePlane (shell.points, indices, profileSize);
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            edgeProfiles.insert ({ GetEdgeKey (indices[i], indices[(i + 1) % profileSize]), profileIndex });
+        }
+        profileStart += profileSize;
+    }
+
+    // Join the profiles that share a reversed edge and lie on the same plane
+    std::vector<UInt32> parents (profileCount);
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        parents[profileIndex] = profileIndex;
+    }
+    bool anyJoined = false;
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        uint32_t profileSize = shell.profileSizes[profileIndex];
+        const uint16_t* indices = &shell.profileIndices[profileStarts[profileIndex]];
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            auto found = edgeProfiles.find (GetEdgeKey (indices[(i + 1) % profileSize], indices[i]));
+            if (found == edgeProfiles.end () || found->second == profileIndex || !IsSamePlane (planes[profileIndex], planes[found->second])) {
+                continue;
+            }
+            UInt32 root = FindRoot (parents, profileIndex);
+            UInt32 otherRoot = FindRoot (parents, found->second);
+            if (root != otherRoot) {
+                parents[GS::Max (root, otherRoot)] = GS::Min (root, otherRoot);
+                anyJoined = true;
+            }
+        }
+    }
+    if (!anyJoined) {
+        return false;
+    }
+
+    // Groups are listed in the order of their first profile
+    std::vector<UInt32> groupIndices (profileCount, NoProfile);
+    std::vector<std::vector<UInt32>>& groups = shellFaces.groups;
+    for (UInt32 profileIndex = 0; profileIndex < profileCount; ++profileIndex) {
+        UInt32 root = FindRoot (parents, profileIndex);
+        if (groupIndices[root] == NoProfile) {
+            groupIndices[root] = (UInt32) groups.size ();
+            groups.emplace_back ();
+        }
+        groups[groupIndices[root]].push_back (profileIndex);
+    }
+
+    shellFaces.faces.resize (groups.size ());
+    shellFaces.mergedGroups.assign (groups.size (), false);
+    size_t outputProfileCount = 0;
+    for (size_t groupIndex = 0; groupIndex < groups.size (); ++groupIndex) {
+        const std::vector<UInt32>& group = groups[groupIndex];
+        MergedFace& face = shellFaces.faces[groupIndex];
+        bool canHaveHoles = outputProfileCount <= 0xFFFF;
+        bool merged = group.size () >= 2 && MergeProfiles (shell, profileStarts, group, planes[group[0]], face) && (face.holes.empty () || canHaveHoles);
+        shellFaces.mergedGroups[groupIndex] = merged;
+        outputProfileCount += merged ? 1 : group.size ();
+    }
+    return true;
+}
+
+// Points of the unmerged profiles are kept, the merged faces keep their corners
+static void KeepShellPoints (const ShellGeometry& shell, bool merged, ShellFaces& shellFaces)
+{
+    std::vector<bool>& keptPoints = shellFaces.keptPoints;
+    keptPoints.assign (shell.points.size (), !merged);
+    for (size_t groupIndex = 0; groupIndex < shellFaces.groups.size (); ++groupIndex) {
+        if (!shellFaces.mergedGroups[groupIndex]) {
+            for (UInt32 profileIndex : shellFaces.groups[groupIndex]) {
+                const uint16_t* indices = &shell.profileIndices[shellFaces.profileStarts[profileIndex]];
+                for (uint32_t i = 0; i < shell.profileSizes[profileIndex]; ++i) {
+                    keptPoints[indices[i]] = true;
+                }
+            }
+            continue;
+        }
+        const MergedFace& face = shellFaces.faces[groupIndex];
+        KeepCornerPoints (shell.points, face.outerIndices, keptPoints);
+        for (const std::vector<uint16_t>& hole : face.holes) {
+            KeepCornerPoints (shell.points, hole, keptPoints);
+        }
+    }
+}
+
+// Points of the shells at the same position are kept if any of them is kept
+static void KeepSamePositionPoints (const std::vector<ShellPoint>& shellPoints, std::vector<ShellFaces>& shellFaces)
+{
+    size_t runStart = 0;
+    for (size_t i = 1; i <= shellPoints.size (); ++i) {
+        if (i < shellPoints.size () && !(shellPoints[runStart] < shellPoints[i])) {
+            continue;
+        }
+        bool kept = false;
+        for (size_t j = runStart; j < i && !kept; ++j) {
+            kept = shellFaces[shellPoints[j].shellIndex].keptPoints[shellPoints[j].pointIndex];
+        }
+        for (size_t j = runStart; j < i && kept; ++j) {
+            shellFaces[shellPoints[j].shellIndex].keptPoints[shellPoints[j].pointIndex] = true;
+        }
+        runStart = i;
+    }
+}
+
+static size_t RebuildShell (ShellGeometry& shell, ShellFaces& shellFaces)
+{
+    std::vector<uint16_t> profileIndices;
+    std::vector<uint32_t> profileSizes;
+    std::vector<uint16_t> holeIndices;
+    std::vector<uint32_t> holeSizes;
+    std::vector<uint16_t> holeProfiles;
+    profileIndices.reserve (shell.profileIndices.size ());
+    auto addOriginalProfile = [&](UInt32 profileIndex) {
+        const uint16_t* indices = &shell.profileIndices[shellFaces.profileStarts[profileIndex]];
+        profileIndices.insert (profileIndices.end (), indices, indices + shell.profileSizes[profileIndex]);
+        profileSizes.push_back (shell.profileSizes[profileIndex]);
+    };
+
+    for (size_t groupIndex = 0; groupIndex < shellFaces.groups.size (); ++groupIndex) {
+        if (!shellFaces.mergedGroups[groupIndex]) {
+            for (UInt32 profileIndex : shellFaces.groups[groupIndex]) {
+                addOriginalProfile (profileIndex);
+            }
+            continue;
+        }
+        MergedFace& face = shellFaces.faces[groupIndex];
+        RemoveCollinearPoints (shellFaces.keptPoints, face.outerIndices);
+        for (std::vector<uint16_t>& hole : face.holes) {
+            RemoveCollinearPoints (shellFaces.keptPoints, hole);
+            holeIndices.insert (holeIndices.end (), hole.begin (), hole.end ());
+            holeSizes.push_back ((uint32_t) hole.size ());
+            holeProfiles.push_back ((uint16_t) profileSizes.size ());
+        }
+        profileIndices.insert (profileIndices.end (), face.outerIndices.begin (), face.outerIndices.end ());
+        profileSizes.push_back ((uint32_t) face.outerIndices.size ());
+    }
+
+    size_t removedCount = shell.profileSizes.size () - profileSizes.size ();
+    shell.profileIndices.swap (profileIndices);
+    shell.profileSizes.swap (profileSizes);
+    shell.holeIndices.swap (holeIndices);
+    shell.holeSizes.swap (holeSizes);
+    shell.holeProfiles.swap (holeProfiles);
+    shell.RemoveUnusedPoints ();
+    return removedCount;
+}
+
+size_t ReconstructShellPolygons (std::vector<ShellGeometry>& shells)
+{
+    std::vector<ShellFaces> shellFaces (shells.size ());
+    std::vector<bool> mergedShells (shells.size (), false);
+    bool anyMerged = false;
+    for (size_t shellIndex = 0; shellIndex < shells.size (); ++shellIndex) {
+        mergedShells[shellIndex] = MergeShellFaces (shells[shellIndex], shellFaces[shellIndex]);
+        anyMerged = anyMerged || mergedShells[shellIndex];
+    }
+    if (!anyMerged) {
+        return 0;
+    }
+
+    // A collinear point is only removed if every loop that uses it removes it, otherwise the
+    // loop that keeps it would have a vertex in the middle of an edge of the other one. The
+    // shells of an element share positions instead of point indices, so those are matched too.
+    std::vector<ShellPoint> shellPoints;
+    for (UInt32 shellIndex = 0; shellIndex < (UInt32) shells.size (); ++shellIndex) {
+        KeepShellPoints (shells[shellIndex], mergedShells[shellIndex], shellFaces[shellIndex]);
+        const std::vector<Vector3D>& points = shells[shellIndex].points;
+        for (UInt32 pointIndex = 0; pointIndex < (UInt32) points.size () && shells.size () > 1; ++pointIndex) {
+            shellPoints.push_back (ShellPoint (points[pointIndex], shellIndex, pointIndex));
+        }
+    }
+    std::sort (shellPoints.begin (), shellPoints.end ());
+
+    bool keptMore = true;
+    while (keptMore) {
+        KeepSamePositionPoints (shellPoints, shellFaces);
+        keptMore = false;
+        for (size_t shellIndex = 0; shellIndex < shells.size (); ++shellIndex) {
+            ShellFaces& faces = shellFaces[shellIndex];
+            for (size_t groupIndex = 0; groupIndex < faces.groups.size (); ++groupIndex) {
+                if (!faces.mergedGroups[groupIndex]) {
+                    continue;
+                }
+                keptMore = KeepDegenerateLoop (faces.faces[groupIndex].outerIndices, faces.keptPoints) || keptMore;
+                for (const std::vector<uint16_t>& hole : faces.faces[groupIndex].holes) {
+                    keptMore = KeepDegenerateLoop (hole, faces.keptPoints) || keptMore;
+                }
+            }
+        }
+    }
+
+    size_t removedCount = 0;
+    for (size_t shellIndex = 0; shellIndex < shells.size (); ++shellIndex) {
+        if (mergedShells[shellIndex]) {
+            removedCount += RebuildShell (shells[shellIndex], shellFaces[shellIndex]);
+        }
+    }
+    return removedCount;
+}
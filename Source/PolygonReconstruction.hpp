@@ -0,0 +1,9 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+
+// Merges the profiles of each shell that are coplanar and connected through shared
+// edges into one outer profile with holes. Collinear points are dropped from the
+// merged outlines only where no other profile of the element keeps them, so the
+// neighbouring faces get no T-junctions. Returns the number of removed profiles.
+size_t ReconstructShellPolygons (std::vector<ShellGeometry>& shells);
@@ -1,71 +1,42 @@
 #include "PropertyUtils.hpp"
 
-#include <ACAPI/IFCObjectAccessor.hpp>
 #include <ACAPI/IFCPropertyAccessor.hpp>
 
-static const GS::UniString IfcBuildingElementProxy = "IFCBUILDINGELEMENTPROXY";
-
-GS::Optional<GS::Guid> GetParentElemGuid (const API_Guid& elemGuid)
+ArchicadIfcPropertySource::ArchicadIfcPropertySource () :
+    IfcPropertySource (),
+    ifcObjectAccessor (IFCAPI::GetObjectAccessor ()),
+    lastElemGuid (),
+    lastObjectId ()
 {
-    API_HierarchicalOwnerType ownerType = API_ParentHierarchicalOwner;
-    API_HierarchicalElemType ownerElemType = API_UnknownElemType;
-    API_Guid ownerGuid = {};
-    if (ACAPI_HierarchicalEditing_GetHierarchicalElementOwner (&elemGuid, &ownerType, &ownerElemType, &ownerGuid) != NoError) {
-        return GS::NoValue;
-    }
-    if (ownerGuid == APINULLGuid || ownerElemType != API_ChildElemInMultipleElem) {
-        return GS::NoValue;
-    }
-    return APIGuid2GSGuid (ownerGuid);
+
 }
 
-GS::UniString GetIfcType (const GS::Guid& elemGuid)
+IfcLookupResult ArchicadIfcPropertySource::GetIfcType (const GS::Guid& elemGuid, GS::UniString& ifcType)
 {
-    API_Elem_Head elemHead = {};
-    elemHead.guid = GSGuid2APIGuid (elemGuid);
-    if (ACAPI_Element_GetHeader (&elemHead) != NoError) {
-        return IfcBuildingElementProxy;
+    const std::optional<IFCAPI::ObjectID>& ifcObjectId = GetObjectId (elemGuid);
+    if (!ifcObjectId.has_value ()) {
+        return IfcLookupResult::Failed;
     }
 
-    IFCAPI::ObjectAccessor ifcObjectAccessor = IFCAPI::GetObjectAccessor ();
-    ACAPI::Result<IFCAPI::ObjectID> ifcObjectId = ifcObjectAccessor.CreateElementObjectID (elemHead);
-    if (!ifcObjectId.IsOk ()) {
-        return IfcBuildingElementProxy;
-    }
-
-    ACAPI::Result<IFCAPI::IFCType> ifcType = ifcObjectAccessor.GetIFCType (ifcObjectId.Unwrap ());
-    if (!ifcType.IsOk ()) {
-        GS::Optional<GS::Guid> parentGuid = GetParentElemGuid (elemHead.guid);
-        if (parentGuid.HasValue ()) {
-            return GetIfcType (parentGuid.Get ());
-        }
-        return IfcBuildingElementProxy;
+    ACAPI::Result<IFCAPI::IFCType> ifcTypeResult = ifcObjectAccessor.GetIFCType (ifcObjectId.value ());
+    if (!ifcTypeResult.IsOk ()) {
+        return IfcLookupResult::NoOwnData;
     }
 
-    return ifcType.Unwrap ().ToUpperCase ();
+    ifcType = ifcTypeResult.Unwrap ().ToUpperCase ();
+    return IfcLookupResult::Found;
 }
 
-void EnumerateIfcAttributes (const GS::Guid& elemGuid, const std::function<void (const GS::UniString&, const GS::UniString&, const GS::UniString&)>& enumerator)
+IfcLookupResult ArchicadIfcPropertySource::EnumerateIfcAttributes (const GS::Guid& elemGuid, const IfcAttributeEnumerator& enumerator)
 {
-    API_Elem_Head elemHead = {};
-    elemHead.guid = GSGuid2APIGuid (elemGuid);
-    if (ACAPI_Element_GetHeader (&elemHead) != NoError) {
-        return;
+    const std::optional<IFCAPI::ObjectID>& ifcObjectId = GetObjectId (elemGuid);
+    if (!ifcObjectId.has_value ()) {
+        return IfcLookupResult::Failed;
     }
 
-    IFCAPI::ObjectAccessor ifcObjectAccessor = IFCAPI::GetObjectAccessor ();
-    ACAPI::Result<IFCAPI::ObjectID> ifcObjectId = ifcObjectAccessor.CreateElementObjectID (elemHead);
-    if (!ifcObjectId.IsOk ()) {
-        return;
-    }
-
-    ACAPI::Result<std::vector<IFCAPI::Attribute>> ifcAttributes = IFCAPI::PropertyAccessor (ifcObjectId.Unwrap ()).GetAttributes ();
+    ACAPI::Result<std::vector<IFCAPI::Attribute>> ifcAttributes = IFCAPI::PropertyAccessor (ifcObjectId.value ()).GetAttributes ();
     if (!ifcAttributes.IsOk ()) {
-        GS::Optional<GS::Guid> parentGuid = GetParentElemGuid (elemHead.guid);
-        if (parentGuid.HasValue ()) {
-            return EnumerateIfcAttributes (parentGuid.Get (), enumerator);
-        }
-        return;
+        return IfcLookupResult::NoOwnData;
     }
 
     for (const IFCAPI::Attribute& ifcAttribute : ifcAttributes.Unwrap ()) {
@@ -78,4 +49,39 @@ void EnumerateIfcAttributes (const GS::Guid& elemGuid, const std::function<void
             );
         }
     }
+    return IfcLookupResult::Found;
+}
+
+GS::Optional<GS::Guid> ArchicadIfcPropertySource::GetParentElemGuid (const GS::Guid& elemGuid)
+{
+    API_Guid apiElemGuid = GSGuid2APIGuid (elemGuid);
+    API_HierarchicalOwnerType ownerType = API_ParentHierarchicalOwner;
+    API_HierarchicalElemType ownerElemType = API_UnknownElemType;
+    API_Guid ownerGuid = {};
+    if (ACAPI_HierarchicalEditing_GetHierarchicalElementOwner (&apiElemGuid, &ownerType, &ownerElemType, &ownerGuid) != NoError) {
+        return GS::NoValue;
+    }
+    if (ownerGuid == APINULLGuid || ownerElemType != API_ChildElemInMultipleElem) {
+        return GS::NoValue;
+    }
+    return APIGuid2GSGuid (ownerGuid);
+}
+
+const std::optional<IFCAPI::ObjectID>& ArchicadIfcPropertySource::GetObjectId (const GS::Guid& elemGuid)
+{
+    if (lastElemGuid.HasValue () && lastElemGuid.Get () == elemGuid) {
+        return lastObjectId;
+    }
+
+    lastElemGuid = elemGuid;
+    lastObjectId.reset ();
+    API_Elem_Head elemHead = {};
+    elemHead.guid = GSGuid2APIGuid (elemGuid);
+    if (ACAPI_Element_GetHeader (&elemHead) == NoError) {
+        ACAPI::Result<IFCAPI::ObjectID> ifcObjectIdResult = ifcObjectAccessor.CreateElementObjectID (elemHead);
+        if (ifcObjectIdResult.IsOk ()) {
+            lastObjectId = ifcObjectIdResult.Unwrap ();
+        }
+    }
+    return lastObjectId;
 }
@@ -1,6 +1,27 @@
 #pragma once
 
 #include <ACAPinc.h>
+#include <ACAPI/IFCObjectAccessor.hpp>
 
-GS::UniString GetIfcType (const GS::Guid& elemGuid);
-void EnumerateIfcAttributes (const GS::Guid& elemGuid, const std::function<void (const GS::UniString&, const GS::UniString&, const GS::UniString&)>& enumerator);
+#include <optional>
+
+#include "IfcPropertySource.hpp"
+
+// Reads the IFC data with the IFC API. The type and attribute queries of an element come
+// right after each other, so the IFC object ID of the last element is kept for both.
+class ArchicadIfcPropertySource : public IfcPropertySource
+{
+public:
+    ArchicadIfcPropertySource ();
+
+    virtual IfcLookupResult GetIfcType (const GS::Guid& elemGuid, GS::UniString& ifcType) override;
+    virtual IfcLookupResult EnumerateIfcAttributes (const GS::Guid& elemGuid, const IfcAttributeEnumerator& enumerator) override;
+    virtual GS::Optional<GS::Guid> GetParentElemGuid (const GS::Guid& elemGuid) override;
+
+private:
+    const std::optional<IFCAPI::ObjectID>& GetObjectId (const GS::Guid& elemGuid);
+
+    IFCAPI::ObjectAccessor ifcObjectAccessor;
+    GS::Optional<GS::Guid> lastElemGuid;
+    std::optional<IFCAPI::ObjectID> lastObjectId;
+};
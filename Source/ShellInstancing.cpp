@@ -0,0 +1,310 @@
+#include "ShellInstancing.hpp"
+
+#include <algorithm>
+#include <functional>
+
+static const double InstanceTolerance = 1.0e-4;
+static const double InstanceHashExtentStep = 1.0e-2;
+static const double DegenerateEigenValueRatio = 1.0e-4;
+
+static double Dot (const Vector3D& a, const Vector3D& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3D Cross (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static Vector3D Add (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static Vector3D Subtract (const Vector3D& a, const Vector3D& b)
+{
+    return Vector3D (a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static Vector3D Scale (const Vector3D& a, double scale)
+{
+    return Vector3D (a.x * scale, a.y * scale, a.z * scale);
+}
+
+static Vector3D Normalize (const Vector3D& a)
+{
+    double length = sqrt (Dot (a, a));
+    return length > 0.0 ? Scale (a, 1.0 / length) : a;
+}
+
+static Vector3D RejectFrom (const Vector3D& a, const Vector3D& direction)
+{
+    return Subtract (a, Scale (direction, Dot (a, direction)));
+}
+
+static void ComputeSymmetricEigenSystem (double matrix[3][3], double eigenValues[3], Vector3D eigenVectors[3])
+{
+    double vectors[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+    static const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+    for (int sweep = 0; sweep < 50; ++sweep) {
+        double offDiagonal = matrix[0][1] * matrix[0][1] + matrix[0][2] * matrix[0][2] + matrix[1][2] * matrix[1][2];
+        double diagonal = matrix[0][0] * matrix[0][0] + matrix[1][1] * matrix[1][1] + matrix[2][2] * matrix[2][2];
+        if (offDiagonal <= 1.0e-30 * diagonal || offDiagonal == 0.0) {
+            break;
+        }
+        for (const int* pair : pairs) {
+            int p = pair[0];
+            int q = pair[1];
+            if (matrix[p][q] == 0.0) {
+                continue;
+            }
+            double theta = (matrix[q][q] - matrix[p][p]) / (2.0 * matrix[p][q]);
+            double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs (theta) + sqrt (theta * theta + 1.0));
+            double c = 1.0 / sqrt (t * t + 1.0);
+            double s = t * c;
+            for (int k = 0; k < 3; ++k) {
+                double kp = matrix[k][p];
+                double kq = matrix[k][q];
+                matrix[k][p] = c * kp - s * kq;
+                matrix[k][q] = s * kp + c * kq;
+            }
+            for (int k = 0; k < 3; ++k) {
+                double pk = matrix[p][k];
+                double qk = matrix[q][k];
+                matrix[p][k] = c * pk - s * qk;
+                matrix[q][k] = s * pk + c * qk;
+            }
+            for (int k = 0; k < 3; ++k) {
+                double kp = vectors[k][p];
+                double kq = vectors[k][q];
+                vectors[k][p] = c * kp - s * kq;
+                vectors[k][q] = s * kp + c * kq;
+            }
+        }
+    }
+
+    int order[3] = { 0, 1, 2 };
+    std::sort (order, order + 3, [&](int a, int b) {
+        return matrix[a][a] > matrix[b][b];
+    });
+    for (int i = 0; i < 3; ++i) {
+        eigenValues[i] = matrix[order[i]][order[i]];
+        eigenVectors[i] = Vector3D (vectors[0][order[i]], vectors[1][order[i]], vectors[2][order[i]]);
+    }
+}
+
+// The point order of copies is the same, so the first point that is not on the
+// plane perpendicular to the direction decides the orientation.
+static bool FindAnchorPoint (const std::vector<Vector3D>& offsets, const Vector3D& direction, double tolerance, Vector3D& anchor)
+{
+    for (const Vector3D& offset : offsets) {
+        Vector3D candidate = RejectFrom (offset, direction);
+        if (Dot (candidate, candidate) > tolerance * tolerance) {
+            anchor = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool OrientAlongPoints (const std::vector<Vector3D>& offsets, double tolerance, Vector3D& direction)
+{
+    for (const Vector3D& offset : offsets) {
+        double projection = Dot (offset, direction);
+        if (fabs (projection) > tolerance) {
+            if (projection < 0.0) {
+                direction = Scale (direction, -1.0);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static Vector3D GetProfileNormal (const ShellGeometry& shell)
+{
+    size_t profileStart = 0;
+    for (uint32_t profileSize : shell.profileSizes) {
+        Vector3D normal (0.0, 0.0, 0.0);
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            const Vector3D& current = shell.points[shell.profileIndices[profileStart + i]];
+            const Vector3D& next = shell.points[shell.profileIndices[profileStart + (i + 1) % profileSize]];
+            normal.x += (current.y - next.y) * (current.z + next.z);
+            normal.y += (current.z - next.z) * (current.x + next.x);
+            normal.z += (current.x - next.x) * (current.y + next.y);
+        }
+        if (Dot (normal, normal) > 0.0) {
+            return Normalize (normal);
+        }
+        profileStart += profileSize;
+    }
+    return Vector3D (0.0, 0.0, 1.0);
+}
+
+static Vector3D GetAnyPerpendicular (const Vector3D& direction)
+{
+    Vector3D axis = fabs (direction.x) < 0.5 ? Vector3D (1.0, 0.0, 0.0) : Vector3D (0.0, 1.0, 0.0);
+    return Normalize (RejectFrom (axis, direction));
+}
+
+static ShellFrame ComputePrincipalFrame (const ShellGeometry& shell)
+{
+    ShellFrame frame;
+    Vector3D centroid (0.0, 0.0, 0.0);
+    for (const Vector3D& point : shell.points) {
+        centroid = Add (centroid, point);
+    }
+    centroid = Scale (centroid, 1.0 / (double) shell.points.size ());
+    frame.origin = centroid;
+
+    std::vector<Vector3D> offsets;
+    offsets.reserve (shell.points.size ());
+    double covariance[3][3] = {};
+    for (const Vector3D& point : shell.points) {
+        Vector3D offset = Subtract (point, centroid);
+        offsets.push_back (offset);
+        double components[3] = { offset.x, offset.y, offset.z };
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                covariance[i][j] += components[i] * components[j];
+            }
+        }
+    }
+
+    double eigenValues[3];
+    Vector3D eigenVectors[3];
+    ComputeSymmetricEigenSystem (covariance, eigenValues, eigenVectors);
+
+    double largest = GS::Max (eigenValues[0], 1.0e-30);
+    bool firstPairEqual = eigenValues[0] - eigenValues[1] <= DegenerateEigenValueRatio * largest;
+    bool secondPairEqual = eigenValues[1] - eigenValues[2] <= DegenerateEigenValueRatio * largest;
+
+    // Eigenvectors of equal eigenvalues are arbitrary, use the points to fix them
+    Vector3D xDirection = eigenVectors[0];
+    Vector3D yDirection = eigenVectors[1];
+    Vector3D anchor;
+    if (firstPairEqual && secondPairEqual) {
+        if (!FindAnchorPoint (offsets, Vector3D (0.0, 0.0, 0.0), InstanceTolerance, anchor)) {
+            return frame;
+        }
+        xDirection = Normalize (anchor);
+        yDirection = FindAnchorPoint (offsets, xDirection, InstanceTolerance, anchor) ? Normalize (anchor) : GetAnyPerpendicular (xDirection);
+    } else if (firstPairEqual) {
+        Vector3D zDirection = eigenVectors[2];
+        if (!OrientAlongPoints (offsets, InstanceTolerance, zDirection) && Dot (GetProfileNormal (shell), zDirection) < 0.0) {
+            zDirection = Scale (zDirection, -1.0);
+        }
+        xDirection = FindAnchorPoint (offsets, zDirection, InstanceTolerance, anchor) ? Normalize (anchor) : GetAnyPerpendicular (zDirection);
+        yDirection = Cross (zDirection, xDirection);
+    } else if (secondPairEqual) {
+        OrientAlongPoints (offsets, InstanceTolerance, xDirection);
+        yDirection = FindAnchorPoint (offsets, xDirection, InstanceTolerance, anchor) ? Normalize (anchor) : GetAnyPerpendicular (xDirection);
+    } else {
+        OrientAlongPoints (offsets, InstanceTolerance, xDirection);
+        OrientAlongPoints (offsets, InstanceTolerance, yDirection);
+    }
+
+    frame.xDirection = Normalize (xDirection);
+    frame.yDirection = Normalize (RejectFrom (yDirection, frame.xDirection));
+    frame.zDirection = Cross (frame.xDirection, frame.yDirection);
+    return frame;
+}
+
+static void CombineHash (size_t& hash, size_t value)
+{
+    hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+}
+
+void CanonicalizeShell (ShellGeometry& shell)
+{
+    if (shell.points.empty ()) {
+        return;
+    }
+
+    ShellFrame frame = ComputePrincipalFrame (shell);
+    shell.min = Vector3D (MaxDouble, MaxDouble, MaxDouble);
+    shell.max = Vector3D (-MaxDouble, -MaxDouble, -MaxDouble);
+    for (Vector3D& point : shell.points) {
+        Vector3D offset = Subtract (point, frame.origin);
+        point = Vector3D (Dot (offset, frame.xDirection), Dot (offset, frame.yDirection), Dot (offset, frame.zDirection));
+        shell.min.x = GS::Min (shell.min.x, point.x);
+        shell.min.y = GS::Min (shell.min.y, point.y);
+        shell.min.z = GS::Min (shell.min.z, point.z);
+        shell.max.x = GS::Max (shell.max.x, point.x);
+        shell.max.y = GS::Max (shell.max.y, point.y);
+        shell.max.z = GS::Max (shell.max.z, point.z);
+    }
+    shell.hasLocalFrame = true;
+    shell.localFrame = frame;
+
+    // Only hash values that do not depend on floating point noise, the points are compared one by one later
+    size_t hash = std::hash<size_t> () (shell.points.size ());
+    for (uint32_t profileSize : shell.profileSizes) {
+        CombineHash (hash, profileSize);
+    }
+    for (uint16_t profileIndex : shell.profileIndices) {
+        CombineHash (hash, profileIndex);
+    }
+    for (size_t i = 0; i < shell.holeSizes.size (); ++i) {
+        CombineHash (hash, shell.holeSizes[i]);
+        CombineHash (hash, shell.holeProfiles[i]);
+    }
+    for (uint16_t holeIndex : shell.holeIndices) {
+        CombineHash (hash, holeIndex);
+    }
+    CombineHash (hash, (size_t) llround ((shell.max.x - shell.min.x) / InstanceHashExtentStep));
+    CombineHash (hash, (size_t) llround ((shell.max.y - shell.min.y) / InstanceHashExtentStep));
+    CombineHash (hash, (size_t) llround ((shell.max.z - shell.min.z) / InstanceHashExtentStep));
+    shell.instanceHash = hash;
+}
+
+bool IsSameShellInstance (const ShellGeometry& shell, const Shell& fbShell, double snapError, double& instanceError)
+{
+    double pointTolerance = InstanceTolerance + snapError;
+    const flatbuffers::Vector<const FloatVector*>* fbPoints = fbShell.points ();
+    const flatbuffers::Vector<flatbuffers::Offset<ShellProfile>>* fbProfiles = fbShell.profiles ();
+    const flatbuffers::Vector<flatbuffers::Offset<ShellHole>>* fbHoles = fbShell.holes ();
+    if (fbPoints->size () != shell.points.size () || fbProfiles->size () != shell.profileSizes.size () || fbHoles->size () != shell.holeSizes.size ()) {
+        return false;
+    }
+
+    double maxPointError = 0.0;
+    for (flatbuffers::uoffset_t i = 0; i < fbPoints->size (); ++i) {
+        const FloatVector* fbPoint = fbPoints->Get (i);
+        const Vector3D& point = shell.points[i];
+        double pointError = GS::Max (GS::Max (fabs (fbPoint->x () - point.x), fabs (fbPoint->y () - point.y)), fabs (fbPoint->z () - point.z));
+        if (pointError > pointTolerance) {
+            return false;
+        }
+        maxPointError = GS::Max (maxPointError, pointError);
+    }
+
+    size_t profileStart = 0;
+    for (flatbuffers::uoffset_t i = 0; i < fbProfiles->size (); ++i) {
+        const flatbuffers::Vector<uint16_t>* fbIndices = fbProfiles->Get (i)->indices ();
+        if (fbIndices->size () != shell.profileSizes[i]) {
+            return false;
+        }
+        if (!std::equal (fbIndices->begin (), fbIndices->end (), shell.profileIndices.begin () + profileStart)) {
+            return false;
+        }
+        profileStart += shell.profileSizes[i];
+    }
+
+    size_t holeStart = 0;
+    for (flatbuffers::uoffset_t i = 0; i < fbHoles->size (); ++i) {
+        const ShellHole* fbHole = fbHoles->Get (i);
+        const flatbuffers::Vector<uint16_t>* fbIndices = fbHole->indices ();
+        if (fbHole->profile_id () != shell.holeProfiles[i] || fbIndices->size () != shell.holeSizes[i]) {
+            return false;
+        }
+        if (!std::equal (fbIndices->begin (), fbIndices->end (), shell.holeIndices.begin () + holeStart)) {
+            return false;
+        }
+        holeStart += shell.holeSizes[i];
+    }
+
+    instanceError = maxPointError;
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+
+// Moves the points of the shell into a local frame derived from their principal axes,
+// so rigidly moved copies of the same geometry end up with the same local points.
+// The frame and a hash of the translation and rotation invariant properties are stored
+// in the shell.
+void CanonicalizeShell (ShellGeometry& shell);
+
+// Checks if an already serialized shell can be used instead of the canonicalized one. The serialized
+// points may be off by the snapping error on top of the instance tolerance, the largest coordinate
+// difference of a matching shell is returned in instanceError.
+bool IsSameShellInstance (const ShellGeometry& shell, const Shell& fbShell, double snapError, double& instanceError);
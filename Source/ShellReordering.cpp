@@ -0,0 +1,186 @@
+#include "ShellReordering.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+static const uint16_t NoIndex = (uint16_t) -1;
+
+// Holes refer to their profile with a 16-bit index
+static const size_t MaxHoleProfileCount = 0x10000;
+
+// Ten bits per axis, so the code of a point fits in 32 bits
+static const double MortonGridSize = 1023.0;
+
+class IndexLoop
+{
+public:
+    IndexLoop (UInt32 key, size_t start, UInt32 size, size_t originalIndex) :
+        key (key),
+        start (start),
+        size (size),
+        originalIndex (originalIndex)
+    {
+
+    }
+
+    bool operator< (const IndexLoop& rhs) const
+    {
+        return key < rhs.key || (key == rhs.key && originalIndex < rhs.originalIndex);
+    }
+
+    UInt32 key;
+    size_t start;
+    UInt32 size;
+    size_t originalIndex;
+};
+
+// Puts two zero bits above each of the lowest ten bits
+static UInt32 SpreadBits (UInt32 value)
+{
+    value &= 0x3ff;
+    value = (value | (value << 16)) & 0x030000ff;
+    value = (value | (value << 8)) & 0x0300f00f;
+    value = (value | (value << 4)) & 0x030c30c3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+}
+
+static UInt32 GetMortonCode (const Vector3D& point, const Vector3D& min, double scale)
+{
+    return
+        SpreadBits ((UInt32) ((point.x - min.x) * scale + 0.5)) |
+        (SpreadBits ((UInt32) ((point.y - min.y) * scale + 0.5)) << 1) |
+        (SpreadBits ((UInt32) ((point.z - min.z) * scale + 0.5)) << 2);
+}
+
+static size_t GetIndexDeltaSum (const std::vector<uint16_t>& indices)
+{
+    size_t deltaSum = 0;
+    for (size_t i = 1; i < indices.size (); ++i) {
+        deltaSum += (size_t) std::abs ((int) indices[i] - (int) indices[i - 1]);
+    }
+    return deltaSum;
+}
+
+static size_t GetIndexDeltaSum (const ShellGeometry& shell)
+{
+    return GetIndexDeltaSum (shell.profileIndices) + GetIndexDeltaSum (shell.holeIndices);
+}
+
+static void AppendLoops (const std::vector<uint16_t>& indices, const std::vector<IndexLoop>& loops, std::vector<uint16_t>& sortedIndices)
+{
+    sortedIndices.clear ();
+    sortedIndices.reserve (indices.size ());
+    for (const IndexLoop& loop : loops) {
+        sortedIndices.insert (sortedIndices.end (), indices.begin () + loop.start, indices.begin () + loop.start + loop.size);
+    }
+}
+
+static void SortProfiles (ShellGeometry& shell)
+{
+    Vector3D min (MaxDouble, MaxDouble, MaxDouble);
+    Vector3D max (-MaxDouble, -MaxDouble, -MaxDouble);
+    for (const Vector3D& point : shell.points) {
+        min = Vector3D (GS::Min (min.x, point.x), GS::Min (min.y, point.y), GS::Min (min.z, point.z));
+        max = Vector3D (GS::Max (max.x, point.x), GS::Max (max.y, point.y), GS::Max (max.z, point.z));
+    }
+
+    // The same scale on every axis, so the cells of the curve are cubes
+    double extent = GS::Max (max.x - min.x, GS::Max (max.y - min.y, max.z - min.z));
+    double scale = extent > 0.0 ? MortonGridSize / extent : 0.0;
+
+    std::vector<IndexLoop> profiles;
+    profiles.reserve (shell.profileSizes.size ());
+    size_t profileStart = 0;
+    for (size_t profileIndex = 0; profileIndex < shell.profileSizes.size (); ++profileIndex) {
+        UInt32 profileSize = shell.profileSizes[profileIndex];
+        Vector3D center (0.0, 0.0, 0.0);
+        for (size_t i = profileStart; i < profileStart + profileSize; ++i) {
+            const Vector3D& point = shell.points[shell.profileIndices[i]];
+            center = Vector3D (center.x + point.x, center.y + point.y, center.z + point.z);
+        }
+        if (profileSize > 0) {
+            center = Vector3D (center.x / profileSize, center.y / profileSize, center.z / profileSize);
+        }
+        profiles.emplace_back (profileSize > 0 ? GetMortonCode (center, min, scale) : 0, profileStart, profileSize, profileIndex);
+        profileStart += profileSize;
+    }
+    std::sort (profiles.begin (), profiles.end ());
+
+    std::vector<UInt32> newProfileIndices (profiles.size ());
+    for (size_t sortedIndex = 0; sortedIndex < profiles.size (); ++sortedIndex) {
+        newProfileIndices[profiles[sortedIndex].originalIndex] = (UInt32) sortedIndex;
+        shell.profileSizes[sortedIndex] = profiles[sortedIndex].size;
+    }
+    std::vector<uint16_t> sortedIndices;
+    AppendLoops (shell.profileIndices, profiles, sortedIndices);
+    shell.profileIndices.swap (sortedIndices);
+
+    // The holes of a profile keep their order
+    std::vector<IndexLoop> holes;
+    holes.reserve (shell.holeSizes.size ());
+    size_t holeStart = 0;
+    for (size_t holeIndex = 0; holeIndex < shell.holeSizes.size (); ++holeIndex) {
+        holes.emplace_back (newProfileIndices[shell.holeProfiles[holeIndex]], holeStart, shell.holeSizes[holeIndex], holeIndex);
+        holeStart += shell.holeSizes[holeIndex];
+    }
+    std::sort (holes.begin (), holes.end ());
+
+    for (size_t sortedIndex = 0; sortedIndex < holes.size (); ++sortedIndex) {
+        shell.holeProfiles[sortedIndex] = (uint16_t) holes[sortedIndex].key;
+        shell.holeSizes[sortedIndex] = holes[sortedIndex].size;
+    }
+    AppendLoops (shell.holeIndices, holes, sortedIndices);
+    shell.holeIndices.swap (sortedIndices);
+}
+
+// Points that are not used by any profile or hole keep their order at the end
+static void RenumberPoints (ShellGeometry& shell)
+{
+    std::vector<uint16_t> newIndices (shell.points.size (), NoIndex);
+    std::vector<Vector3D> sortedPoints;
+    sortedPoints.reserve (shell.points.size ());
+    auto renumber = [&](uint16_t& index) {
+        if (newIndices[index] == NoIndex) {
+            newIndices[index] = (uint16_t) sortedPoints.size ();
+            sortedPoints.push_back (shell.points[index]);
+        }
+        index = newIndices[index];
+    };
+    for (uint16_t& index : shell.profileIndices) {
+        renumber (index);
+    }
+    for (uint16_t& index : shell.holeIndices) {
+        renumber (index);
+    }
+    for (size_t pointIndex = 0; pointIndex < shell.points.size (); ++pointIndex) {
+        if (newIndices[pointIndex] == NoIndex) {
+            sortedPoints.push_back (shell.points[pointIndex]);
+        }
+    }
+    shell.points.swap (sortedPoints);
+}
+
+// Starting a loop at its smallest index keeps the first index of the loops close to the previous ones
+static void RotateLoops (std::vector<uint16_t>& indices, const std::vector<UInt32>& sizes)
+{
+    size_t start = 0;
+    for (UInt32 size : sizes) {
+        auto begin = indices.begin () + start;
+        std::rotate (begin, std::min_element (begin, begin + size), begin + size);
+        start += size;
+    }
+}
+
+void ReorderShell (ShellGeometry& shell, size_t& indexDeltaSumBefore, size_t& indexDeltaSumAfter)
+{
+    indexDeltaSumBefore += GetIndexDeltaSum (shell);
+    // The sort could move a profile with holes beyond the reach of their profile index
+    if (shell.holeSizes.empty () || shell.profileSizes.size () <= MaxHoleProfileCount) {
+        SortProfiles (shell);
+    }
+    RenumberPoints (shell);
+    RotateLoops (shell.profileIndices, shell.profileSizes);
+    RotateLoops (shell.holeIndices, shell.holeSizes);
+    indexDeltaSumAfter += GetIndexDeltaSum (shell);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+
+// Sorts the profiles of the shell along a Morton curve by their centers, the holes follow their
+// profiles. Then the points are renumbered in the order the sorted profiles and holes first use them,
+// and each profile and hole starts at its smallest index. Neighbouring profiles get close indices, so
+// the index deltas are small for deflate and the triangles reuse recent vertices in the viewer. The
+// winding of the profiles is kept. A shell with holes and more profiles than a hole can refer to keeps
+// its profile order. The sums of the absolute differences of consecutive indices before
+// and after the reordering are added to the arguments.
+void ReorderShell (ShellGeometry& shell, size_t& indexDeltaSumBefore, size_t& indexDeltaSumAfter);
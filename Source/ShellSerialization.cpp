@@ -0,0 +1,130 @@
+#include "ShellSerialization.hpp"
+
+#include <cmath>
+#include <mutex>
+
+// Shell subtrees contain nothing wider than an offset or a float
+static const size_t ShellAlignment = sizeof (flatbuffers::uoffset_t);
+
+static std::mutex shellBuilderPoolMutex;
+static std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> shellBuilderPool;
+
+Vector3D GetShellOrigin (const ShellGeometry& shell, const Vector3D& itemCenter)
+{
+    return shell.hasLocalFrame ? Vector3D (0.0, 0.0, 0.0) : itemCenter;
+}
+
+float GetStoredCoordinate (double coordinate, double gridSize)
+{
+    return (float) (gridSize > 0.0 ? std::round (coordinate / gridSize) * gridSize : coordinate);
+}
+
+static float SnapCoordinate (double coordinate, double gridSize, double& maxError)
+{
+    float snapped = GetStoredCoordinate (coordinate, gridSize);
+    maxError = GS::Max (maxError, std::fabs ((double) snapped - coordinate));
+    return snapped;
+}
+
+double GetCoordinateGridSize (double precision)
+{
+    if (precision <= 0.0) {
+        return 0.0;
+    }
+    return std::exp2 (std::floor (std::log2 (precision)));
+}
+
+SerializedShells::SerializedShells () :
+    bytes (),
+    shellStarts (),
+    shellOffsets (),
+    fbProfiles (),
+    fbHoles (),
+    maxCoordinateError (0.0)
+{
+
+}
+
+void SerializedShells::Clear ()
+{
+    bytes.clear ();
+    shellStarts.clear ();
+    shellOffsets.clear ();
+    maxCoordinateError = 0.0;
+}
+
+void SerializedShells::Add (flatbuffers::FlatBufferBuilder& shellBuilder, const ShellGeometry& shell, const Vector3D& itemCenter, double gridSize)
+{
+    Vector3D origin = GetShellOrigin (shell, itemCenter);
+    shellBuilder.Clear ();
+    fbProfiles.clear ();
+    fbHoles.clear ();
+    size_t profileStart = 0;
+    for (uint32_t profileSize : shell.profileSizes) {
+        flatbuffers::Offset<flatbuffers::Vector<uint16_t>> fbShellProfileIndices = shellBuilder.CreateVector (shell.profileIndices.data () + profileStart, profileSize);
+        fbProfiles.push_back (CreateShellProfile (shellBuilder, fbShellProfileIndices));
+        profileStart += profileSize;
+    }
+
+    size_t holeStart = 0;
+    for (size_t holeIndex = 0; holeIndex < shell.holeSizes.size (); ++holeIndex) {
+        flatbuffers::Offset<flatbuffers::Vector<uint16_t>> fbShellHoleIndices = shellBuilder.CreateVector (shell.holeIndices.data () + holeStart, shell.holeSizes[holeIndex]);
+        fbHoles.push_back (CreateShellHole (shellBuilder, fbShellHoleIndices, shell.holeProfiles[holeIndex]));
+        holeStart += shell.holeSizes[holeIndex];
+    }
+
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<ShellProfile>>> fbProfilesVector = shellBuilder.CreateVector (fbProfiles);
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<ShellHole>>> fbHolesVector = shellBuilder.CreateVector (fbHoles);
+
+    // The points are written straight into the builder, the pointer is valid until the next builder call
+    FloatVector* fbPoints = nullptr;
+    flatbuffers::Offset<flatbuffers::Vector<const FloatVector*>> fbPointsVector = shellBuilder.CreateUninitializedVectorOfStructs (shell.points.size (), &fbPoints);
+    for (size_t pointIndex = 0; pointIndex < shell.points.size (); ++pointIndex) {
+        const Vector3D& point = shell.points[pointIndex];
+        fbPoints[pointIndex] = FloatVector (
+            SnapCoordinate (point.x - origin.x, gridSize, maxCoordinateError),
+            SnapCoordinate (point.y - origin.y, gridSize, maxCoordinateError),
+            SnapCoordinate (point.z - origin.z, gridSize, maxCoordinateError)
+        );
+    }
+
+    flatbuffers::Offset<Shell> fbShell = CreateShell (shellBuilder, fbProfilesVector, fbHolesVector, fbPointsVector);
+    shellStarts.push_back (bytes.size ());
+    shellOffsets.push_back (fbShell.o);
+    bytes.insert (bytes.end (), shellBuilder.GetCurrentBufferPointer (), shellBuilder.GetCurrentBufferPointer () + shellBuilder.GetSize ());
+}
+
+flatbuffers::Offset<Shell> SerializedShells::Splice (flatbuffers::FlatBufferBuilder& builder, size_t shellIndex) const
+{
+    size_t shellStart = shellStarts[shellIndex];
+    size_t shellEnd = shellIndex + 1 < shellStarts.size () ? shellStarts[shellIndex + 1] : bytes.size ();
+
+    // Offsets count from the end of the buffer, so the shell moves by the size of the model buffer
+    builder.Align (ShellAlignment);
+    flatbuffers::uoffset_t sizeBefore = builder.GetSize ();
+    builder.PushBytes (bytes.data () + shellStart, shellEnd - shellStart);
+    return flatbuffers::Offset<Shell> (sizeBefore + shellOffsets[shellIndex]);
+}
+
+double SerializedShells::GetMaxCoordinateError () const
+{
+    return maxCoordinateError;
+}
+
+std::unique_ptr<flatbuffers::FlatBufferBuilder> AcquireShellBuilder ()
+{
+    std::lock_guard<std::mutex> lock (shellBuilderPoolMutex);
+    if (shellBuilderPool.empty ()) {
+        return std::unique_ptr<flatbuffers::FlatBufferBuilder> (new flatbuffers::FlatBufferBuilder ());
+    }
+    std::unique_ptr<flatbuffers::FlatBufferBuilder> shellBuilder = std::move (shellBuilderPool.back ());
+    shellBuilderPool.pop_back ();
+    return shellBuilder;
+}
+
+void ReleaseShellBuilder (std::unique_ptr<flatbuffers::FlatBufferBuilder> shellBuilder)
+{
+    shellBuilder->Clear ();
+    std::lock_guard<std::mutex> lock (shellBuilderPoolMutex);
+    shellBuilderPool.push_back (std::move (shellBuilder));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "ElementGeometry.hpp"
+
+// Shells in a local frame are positioned by their local transform, the others are stored
+// relative to the center of their item.
+Vector3D GetShellOrigin (const ShellGeometry& shell, const Vector3D& itemCenter);
+
+// Grid of the shell point coordinates for the given precision, 0 means no snapping. The step is a
+// power of two, so the snapped coordinates are exact in float and their low mantissa bits are zero,
+// which is what makes them compress better.
+double GetCoordinateGridSize (double precision);
+
+// Coordinate as it is stored in the shell points. Snapping keeps the order of the coordinates,
+// so the stored bounding box corners are the bounding box of the stored points.
+float GetStoredCoordinate (double coordinate, double gridSize);
+
+// Shell tables serialized one by one in a separate builder, so they can be built on any thread
+// and copied into the model buffer later. Offsets inside a flatbuffer are relative, so the
+// copied bytes stay valid, only the offset of the shell table is relocated on splicing.
+class SerializedShells
+{
+public:
+    SerializedShells ();
+
+    void Clear ();
+    // Points are snapped to the grid in the frame they are stored in, so the origin is on the grid
+    void Add (flatbuffers::FlatBufferBuilder& shellBuilder, const ShellGeometry& shell, const Vector3D& itemCenter, double gridSize);
+
+    flatbuffers::Offset<Shell> Splice (flatbuffers::FlatBufferBuilder& builder, size_t shellIndex) const;
+
+    // Largest distance of a stored coordinate from the exact one since the last clear
+    double GetMaxCoordinateError () const;
+
+private:
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> shellStarts;
+    std::vector<flatbuffers::uoffset_t> shellOffsets;
+    std::vector<flatbuffers::Offset<ShellProfile>> fbProfiles;
+    std::vector<flatbuffers::Offset<ShellHole>> fbHoles;
+    double maxCoordinateError;
+};
+
+// Builders for the shells are kept between exports, so their buffers do not have to grow again.
+// A builder holds one shell at a time, so the kept memory is bounded by the largest shell.
+std::unique_ptr<flatbuffers::FlatBufferBuilder> AcquireShellBuilder ();
+void ReleaseShellBuilder (std::unique_ptr<flatbuffers::FlatBufferBuilder> shellBuilder);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Definitions.hpp>
+
+#include <chrono>
+#include <thread>
+
+// Waits for a condition set by another thread. Short waits spin, longer ones sleep, so a
+// waiting thread does not keep a core busy. Returns the waited time in microseconds.
+template <typename Condition>
+UInt64 WaitFor (const Condition& condition)
+{
+    static const UInt32 SpinCount = 64;
+    static const std::chrono::microseconds SleepTime (50);
+
+    if (condition ()) {
+        return 0;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    UInt32 spinCount = 0;
+    while (!condition ()) {
+        if (spinCount < SpinCount) {
+            spinCount += 1;
+            std::this_thread::yield ();
+        } else {
+            std::this_thread::sleep_for (SleepTime);
+        }
+    }
+    return (UInt64) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now () - start).count ();
+}
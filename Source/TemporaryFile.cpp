@@ -0,0 +1,181 @@
+#include "TemporaryFile.hpp"
+
+#if defined (WINDOWS)
+#include <Win32Interface.hpp>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// The temporary file never replaces an existing file, the first free name is used
+static const UInt32 MaxTemporaryFileAttempts = 100;
+
+// Larger writes are split, the size of a single write is limited on both platforms
+static const size_t MaxWriteSize = 1 << 30;
+
+static void DeleteTemporaryFile (const GS::UniString& path)
+{
+#if defined (WINDOWS)
+    auto widePath = path.ToUStr ();
+    DeleteFileW (reinterpret_cast<const wchar_t*> (widePath.Get ()));
+#else
+    unlink (path.ToCStr (CC_UTF8).Get ());
+#endif
+}
+
+static bool RenameTemporaryFile (const GS::UniString& sourcePath, const GS::UniString& targetPath)
+{
+#if defined (WINDOWS)
+    auto wideSourcePath = sourcePath.ToUStr ();
+    auto wideTargetPath = targetPath.ToUStr ();
+    return MoveFileExW (reinterpret_cast<const wchar_t*> (wideSourcePath.Get ()), reinterpret_cast<const wchar_t*> (wideTargetPath.Get ()), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return rename (sourcePath.ToCStr (CC_UTF8).Get (), targetPath.ToCStr (CC_UTF8).Get ()) == 0;
+#endif
+}
+
+TemporaryFile::TemporaryFile () :
+    path (),
+    temporaryPath (),
+#if defined (WINDOWS)
+    fileHandle (INVALID_HANDLE_VALUE)
+#else
+    fileDescriptor (-1)
+#endif
+{
+
+}
+
+TemporaryFile::~TemporaryFile ()
+{
+    if (IsOpen ()) {
+        Close ();
+        DeleteTemporaryFile (temporaryPath);
+    }
+}
+
+bool TemporaryFile::Open (const IO::Location& location)
+{
+    if (location.ToPath (&path) != NoError) {
+        return false;
+    }
+
+    // The temporary file is next to the destination, so the rename does not copy
+    for (UInt32 attempt = 0; attempt < MaxTemporaryFileAttempts; attempt++) {
+        temporaryPath = path + GS::UniString::Printf (".%u.tmp", attempt);
+#if defined (WINDOWS)
+        auto wideTemporaryPath = temporaryPath.ToUStr ();
+        fileHandle = CreateFileW (reinterpret_cast<const wchar_t*> (wideTemporaryPath.Get ()), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            return true;
+        }
+        if (GetLastError () != ERROR_FILE_EXISTS) {
+            return false;
+        }
+#else
+        fileDescriptor = open (temporaryPath.ToCStr (CC_UTF8).Get (), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fileDescriptor != -1) {
+            return true;
+        }
+        if (errno != EEXIST) {
+            return false;
+        }
+#endif
+    }
+    return false;
+}
+
+bool TemporaryFile::Write (const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*> (data);
+    while (size > 0) {
+        size_t writeSize = GS::Min (size, MaxWriteSize);
+#if defined (WINDOWS)
+        DWORD writtenSize = 0;
+        if (!WriteFile (fileHandle, bytes, (DWORD) writeSize, &writtenSize, nullptr) || writtenSize == 0) {
+            return false;
+        }
+#else
+        ssize_t writtenSize = write (fileDescriptor, bytes, writeSize);
+        if (writtenSize == -1 && errno == EINTR) {
+            continue;
+        }
+        if (writtenSize <= 0) {
+            return false;
+        }
+#endif
+        bytes += writtenSize;
+        size -= (size_t) writtenSize;
+    }
+    return true;
+}
+
+bool TemporaryFile::Resize (size_t size)
+{
+#if defined (WINDOWS)
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = (LONGLONG) size;
+    return SetFilePointerEx (fileHandle, fileSize, nullptr, FILE_BEGIN) && SetEndOfFile (fileHandle);
+#else
+    return ftruncate (fileDescriptor, (off_t) size) == 0;
+#endif
+}
+
+bool TemporaryFile::Commit ()
+{
+    if (!IsOpen ()) {
+        return false;
+    }
+
+    // Closing flushes the file, a failed close is a failed write
+#if defined (WINDOWS)
+    bool success = CloseHandle (fileHandle) != FALSE;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    bool success = close (fileDescriptor) == 0;
+    fileDescriptor = -1;
+#endif
+    success = success && RenameTemporaryFile (temporaryPath, path);
+    if (!success) {
+        DeleteTemporaryFile (temporaryPath);
+    }
+    return success;
+}
+
+#if defined (WINDOWS)
+
+void* TemporaryFile::GetHandle () const
+{
+    return fileHandle;
+}
+
+#else
+
+int TemporaryFile::GetDescriptor () const
+{
+    return fileDescriptor;
+}
+
+#endif
+
+bool TemporaryFile::IsOpen () const
+{
+#if defined (WINDOWS)
+    return fileHandle != INVALID_HANDLE_VALUE;
+#else
+    return fileDescriptor != -1;
+#endif
+}
+
+void TemporaryFile::Close ()
+{
+#if defined (WINDOWS)
+    CloseHandle (fileHandle);
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    close (fileDescriptor);
+    fileDescriptor = -1;
+#endif
+}
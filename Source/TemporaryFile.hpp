@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Location.hpp>
+
+// File next to its destination that is renamed over the destination once it is complete, so a
+// failed export never leaves a partial file in place of the previous one. It gets a name that is
+// not taken yet, so it never replaces an existing file either. A file that was not committed is
+// deleted.
+class TemporaryFile
+{
+public:
+    TemporaryFile ();
+    ~TemporaryFile ();
+
+    bool Open (const IO::Location& location);
+    bool Write (const void* data, size_t size);
+    bool Resize (size_t size);
+    bool Commit ();
+
+#if defined (WINDOWS)
+    void* GetHandle () const;
+#else
+    int GetDescriptor () const;
+#endif
+
+private:
+    bool IsOpen () const;
+    void Close ();
+
+    GS::UniString path;
+    GS::UniString temporaryPath;
+#if defined (WINDOWS)
+    void* fileHandle;
+#else
+    int fileDescriptor;
+#endif
+};
@@ -0,0 +1,142 @@
+#include "VertexWelding.hpp"
+
+#include <unordered_map>
+
+static const UInt32 NoPoint = (UInt32) -1;
+
+class GridCell
+{
+public:
+    GridCell (Int64 x, Int64 y, Int64 z) :
+        x (x),
+        y (y),
+        z (z)
+    {
+
+    }
+
+    bool operator== (const GridCell& rhs) const
+    {
+        return x == rhs.x && y == rhs.y && z == rhs.z;
+    }
+
+    Int64 x;
+    Int64 y;
+    Int64 z;
+};
+
+class GridCellHash
+{
+public:
+    size_t operator() (const GridCell& cell) const noexcept
+    {
+        // Unsigned, so large cell coordinates wrap around instead of overflowing
+        return (size_t) ((UInt64) cell.x * 73856093 ^ (UInt64) cell.y * 19349663 ^ (UInt64) cell.z * 83492791);
+    }
+};
+
+static Int64 GetCellCoordinate (double value, double cellSize)
+{
+    return (Int64) floor (value / cellSize);
+}
+
+static double GetSquaredDistance (const Vector3D& a, const Vector3D& b)
+{
+    double dx = a.x - b.x;
+    double dy = a.y - b.y;
+    double dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Every kept point is registered in the grid, a point is welded to the first kept
+// point found within the tolerance in its own or in one of the neighbouring cells.
+static size_t FindWeldTargets (const std::vector<Vector3D>& points, double tolerance, std::vector<UInt32>& weldTargets)
+{
+    std::unordered_map<GridCell, UInt32, GridCellHash> firstPointInCell;
+    firstPointInCell.reserve (points.size ());
+    std::vector<UInt32> nextPointInCell (points.size (), NoPoint);
+    weldTargets.assign (points.size (), NoPoint);
+
+    double squaredTolerance = tolerance * tolerance;
+    size_t weldedCount = 0;
+    for (UInt32 pointIndex = 0; pointIndex < (UInt32) points.size (); ++pointIndex) {
+        const Vector3D& point = points[pointIndex];
+        GridCell cell (GetCellCoordinate (point.x, tolerance), GetCellCoordinate (point.y, tolerance), GetCellCoordinate (point.z, tolerance));
+        UInt32 target = NoPoint;
+        for (Int64 dx = -1; dx <= 1 && target == NoPoint; ++dx) {
+            for (Int64 dy = -1; dy <= 1 && target == NoPoint; ++dy) {
+                for (Int64 dz = -1; dz <= 1 && target == NoPoint; ++dz) {
+                    auto found = firstPointInCell.find (GridCell (cell.x + dx, cell.y + dy, cell.z + dz));
+                    if (found == firstPointInCell.end ()) {
+                        continue;
+                    }
+                    for (UInt32 candidate = found->second; candidate != NoPoint; candidate = nextPointInCell[candidate]) {
+                        if (GetSquaredDistance (points[candidate], point) <= squaredTolerance) {
+                            target = candidate;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (target != NoPoint) {
+            weldTargets[pointIndex] = target;
+            weldedCount += 1;
+            continue;
+        }
+
+        weldTargets[pointIndex] = pointIndex;
+        auto inserted = firstPointInCell.insert ({ cell, pointIndex });
+        if (!inserted.second) {
+            nextPointInCell[pointIndex] = inserted.first->second;
+            inserted.first->second = pointIndex;
+        }
+    }
+    return weldedCount;
+}
+
+size_t WeldShellPoints (ShellGeometry& shell, double tolerance)
+{
+    if (tolerance <= 0.0 || shell.points.size () < 2) {
+        return 0;
+    }
+
+    std::vector<UInt32> weldTargets;
+    if (FindWeldTargets (shell.points, tolerance, weldTargets) == 0) {
+        return 0;
+    }
+
+    // Remap the profiles, and drop the repeated corners and collapsed profiles
+    std::vector<uint16_t> profileIndices;
+    std::vector<uint32_t> profileSizes;
+    profileIndices.reserve (shell.profileIndices.size ());
+    profileSizes.reserve (shell.profileSizes.size ());
+    size_t profileStart = 0;
+    for (uint32_t profileSize : shell.profileSizes) {
+        size_t newProfileStart = profileIndices.size ();
+        for (uint32_t i = 0; i < profileSize; ++i) {
+            uint16_t pointIndex = (uint16_t) weldTargets[shell.profileIndices[profileStart + i]];
+            if (profileIndices.size () > newProfileStart && profileIndices.back () == pointIndex) {
+                continue;
+            }
+            profileIndices.push_back (pointIndex);
+        }
+        while (profileIndices.size () > newProfileStart + 1 && profileIndices.back () == profileIndices[newProfileStart]) {
+            profileIndices.pop_back ();
+        }
+        uint32_t newProfileSize = (uint32_t) (profileIndices.size () - newProfileStart);
+        if (newProfileSize < 3) {
+            profileIndices.resize (newProfileStart);
+        } else {
+            profileSizes.push_back (newProfileSize);
+        }
+        profileStart += profileSize;
+    }
+
+    size_t pointCount = shell.points.size ();
+    shell.profileIndices.swap (profileIndices);
+    shell.profileSizes.swap (profileSizes);
+    shell.RemoveUnusedPoints ();
+    return pointCount - shell.points.size ();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "ElementGeometry.hpp"
+
+// Merges points of the shell that are closer than the tolerance, and removes the
+// profiles that become degenerate. Returns the number of removed points.
+size_t WeldShellPoints (ShellGeometry& shell, double tolerance);